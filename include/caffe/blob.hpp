@@ -14,9 +14,14 @@ class Blob {
  public:
   Blob()
        : num_(0), channels_(0), height_(0), width_(0), count_(0), data_(),
-       diff_() {}
+       diff_(), diff_enabled_(true), memory_tracker_(), data_tag_(-1),
+       diff_tag_(-1) {}
   explicit Blob(const int num, const int channels, const int height,
     const int width);
+  // Reshape only reallocates the data and diff when they are too small for
+  // the new count; otherwise they are kept with their contents. Data or diff
+  // shared with another blob, or set with set_cpu_data, is always replaced.
+  // Reshaping to no elements releases both.
   void Reshape(const int num, const int channels, const int height,
     const int width);
   void ReshapeLike(const Blob& other);
@@ -58,6 +63,8 @@ class Blob {
   }
 
   inline const shared_ptr<SyncedMemory>& diff() const {
+    CHECK(diff_enabled_) << "The diff of this blob is disabled; it belongs to "
+        "an inference-only net.";
     CHECK(diff_);
     return diff_;
   }
@@ -82,15 +89,39 @@ class Blob {
   // shared_ptr calls its destructor when reset with the = operator.
   void ShareData(const Blob& other);
   void ShareDiff(const Blob& other);
+  // Exchange the data_ SyncedMemory with that of Blob other, which must have
+  // the same count. The prefetching data layers use this to hand a filled
+  // batch to their top blob without copying it.
+  void SwapData(Blob* other);
+  // Points the data at buffer, which may be larger than the blob. Net uses
+  // this to let blobs that are not used at the same time share memory.
+  void set_data(const shared_ptr<SyncedMemory>& buffer);
+  // Frees the diff, and keeps Reshape from allocating one: any later access
+  // to the diff fails. FromProto then ignores the diff of the proto.
+  void DisableDiff();
+  inline bool diff_enabled() const { return diff_enabled_; }
+  // Counts the host memory of the data and diff in tracker under owner, now
+  // and after every Reshape.
+  void TrackMemory(const shared_ptr<MemoryTracker>& tracker,
+      const string& owner, MemoryTracker::Kind data_kind,
+      MemoryTracker::Kind diff_kind);
 
  protected:
+  // Whether Reshape may keep memory for size bytes.
+  static bool Reusable(const shared_ptr<SyncedMemory>& memory,
+      const size_t size);
+
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
+  bool diff_enabled_;
   int num_;
   int channels_;
   int height_;
   int width_;
   int count_;
+  shared_ptr<MemoryTracker> memory_tracker_;
+  int data_tag_;
+  int diff_tag_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
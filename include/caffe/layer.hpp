@@ -3,10 +3,12 @@
 #ifndef CAFFE_LAYER_H_
 #define CAFFE_LAYER_H_
 
+#include <string>
 #include <vector>
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/trace.hpp"
 
 using std::vector;
 
@@ -52,12 +54,45 @@ class Layer {
   const LayerParameter& layer_param() { return layer_param_; }
   // Writes the layer parameter to a protocol buffer
   virtual void ToProto(LayerParameter* param, bool write_diff = false);
+  // Sets the tracker the buffers the layer allocates are counted in, under
+  // owner. Net sets it before SetUp, and counts the parameters itself.
+  void set_memory_tracker(const shared_ptr<MemoryTracker>& tracker,
+      const string& owner) {
+    memory_tracker_ = tracker;
+    memory_owner_ = owner;
+  }
+
+  // Data layers that can resume reading where they left off report their
+  // read position, and return true. Seeking to a position they reported
+  // makes the next Forward continue from it.
+  virtual bool GetDataCursor(DataCursor* cursor) { return false; }
+  virtual void SeekDataCursor(const DataCursor& cursor) {
+    LOG(FATAL) << "Layer " << layer_param_.name()
+        << " cannot seek to a data cursor.";
+  }
 
  protected:
   // The protobuf that stores the layer parameters
   LayerParameter layer_param_;
   // The vector that stores the parameters as a set of blobs.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
+  // Where the layer's buffers are counted; NULL outside of a Net.
+  shared_ptr<MemoryTracker> memory_tracker_;
+  string memory_owner_;
+
+  // Count a buffer of the layer in its memory tracker, if any. Layers call
+  // these in SetUp, before any thread of theirs allocates the buffer.
+  void TrackMemory(Blob<Dtype>* blob, MemoryTracker::Kind kind) {
+    if (memory_tracker_) {
+      blob->TrackMemory(memory_tracker_, memory_owner_, kind, kind);
+    }
+  }
+  void TrackMemory(SyncedMemory* memory, MemoryTracker::Kind kind) {
+    if (memory_tracker_ && memory) {
+      memory->set_tracker(memory_tracker_,
+          memory_tracker_->Register(memory_owner_, kind));
+    }
+  }
 
   // Forward functions: compute the layer output
   // (and loss layers return the loss; other layers return the dummy value 0.)
@@ -91,6 +126,7 @@ class Layer {
 template <typename Dtype>
 inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
+  TraceScope trace(layer_param_.name().c_str(), "forward");
   switch (Caffe::mode()) {
   case Caffe::CPU:
     return Forward_cpu(bottom, top);
@@ -106,6 +142,7 @@ template <typename Dtype>
 inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const bool propagate_down,
     vector<Blob<Dtype>*>* bottom) {
+  TraceScope trace(layer_param_.name().c_str(), "backward");
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Backward_cpu(top, propagate_down, bottom);
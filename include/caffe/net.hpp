@@ -3,6 +3,9 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <stdint.h>
+
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -11,6 +14,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 
 using std::map;
 using std::vector;
@@ -18,6 +22,28 @@ using std::string;
 
 namespace caffe {
 
+// The calls of a layer in one direction while the net was profiling.
+struct PassProfile {
+  PassProfile() : count(0), total_ms(0), min_ms(0), max_ms(0) {}
+  inline void Add(double ms) {
+    min_ms = count ? std::min(min_ms, ms) : ms;
+    max_ms = count ? std::max(max_ms, ms) : ms;
+    total_ms += ms;
+    ++count;
+  }
+  int64_t count;
+  double total_ms;
+  double min_ms;
+  double max_ms;
+};
+
+struct LayerProfile {
+  LayerProfile() : top_bytes(0) {}
+  PassProfile forward;
+  PassProfile backward;
+  // The bytes of the top blobs written by all the forward calls.
+  int64_t top_bytes;
+};
 
 template <typename Dtype>
 class Net {
@@ -64,9 +90,17 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   // Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false);
+  // Saves the read positions of the data layers, and seeks the data layers
+  // of the same name back to them.
+  void GetDataCursors(
+      google::protobuf::RepeatedPtrField<DataCursor>* cursors);
+  void SeekDataCursors(
+      const google::protobuf::RepeatedPtrField<DataCursor>& cursors);
 
   // returns the network name.
   inline const string& name() { return name_; }
+  // Whether the net was created with inference_only, without diffs.
+  inline bool inference_only() { return inference_only_; }
   // returns the layer names
   inline const vector<string>& layer_names() { return layer_names_; }
   // returns the blob names
@@ -92,15 +126,42 @@ class Net {
   // has_blob and blob_by_name are inspired by
   // https://github.com/kencoken/caffe/commit/f36e71569455c9fbb4bf8a63c2d53224e32a4e7b
   // Access intermediary computation layers, testing with centre image only
+  // With share_activations, blob_by_name gives the blob back its own memory,
+  // with the data of the last Forward, so that it stays valid after each
+  // Forward; blobs() does not.
   bool has_blob(const string& blob_name);
   const shared_ptr<Blob<Dtype> > blob_by_name(const string& blob_name);
   bool has_layer(const string& layer_name);
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name);
 
+  // While profiling, ForwardPrefilled and Backward time every layer call,
+  // with the GPU synchronized around each one in GPU mode. Off by default,
+  // where it costs a branch per layer.
+  void set_profiling(bool profiling);
+  inline bool profiling() { return profiling_; }
+  // The profile of each layer, in the order of layers(), since the last
+  // ResetProfile.
+  inline const vector<LayerProfile>& layer_profiles() {
+    return layer_profiles_;
+  }
+  void ResetProfile();
+  // Logs the profile of every layer that ran, with its share of the time.
+  void LogProfile();
+
+  // Counts the host memory of the blobs, parameters and layer buffers of the
+  // net. Memory is allocated on first use, so the counts are meaningful
+  // after a Forward (and Backward).
+  inline const shared_ptr<MemoryTracker>& memory_tracker() {
+    return memory_tracker_;
+  }
+
  protected:
   // Function to get misc parameters, e.g. the learning rate multiplier and
   // weight decay.
   void GetLearningRateAndWeightDecay();
+  // Assigns the intermediate blobs to shared buffers so that blobs used at
+  // the same time never share one, from the layers each blob is used by.
+  void ShareActivations();
 
   // Individual layers in the net
   vector<shared_ptr<Layer<Dtype> > > layers_;
@@ -126,6 +187,15 @@ class Net {
   vector<int> net_output_blob_indices_;
   vector<Blob<Dtype>*> net_input_blobs_;
   vector<Blob<Dtype>*> net_output_blobs_;
+  // With share_activations, the shared buffer holding the data of each blob,
+  // or -1, and the blob whose data each blob aliases through split and
+  // flatten layers, or itself.
+  vector<int> blob_buffer_ids_;
+  vector<int> blob_alias_roots_;
+  bool share_activations_;
+  bool inference_only_;
+  // Whether ForwardPrefilled has run, so that shared blobs hold data.
+  bool forwarded_;
   string name_;
   // The parameters in the network.
   vector<shared_ptr<Blob<Dtype> > > params_;
@@ -133,6 +203,10 @@ class Net {
   vector<float> params_lr_;
   // the weight decay multipliers
   vector<float> params_weight_decay_;
+  bool profiling_;
+  vector<LayerProfile> layer_profiles_;
+  shared_ptr<Timer> profile_timer_;
+  shared_ptr<MemoryTracker> memory_tracker_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
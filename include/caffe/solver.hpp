@@ -30,8 +30,10 @@ class Solver {
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
   // function that produces a SolverState protocol buffer that needs to be
-  // written to disk together with the learned net.
+  // written to disk together with the learned net. The trace, if any, is
+  // written next to them.
   void Snapshot();
+  void SnapshotNetAndState();
   // The test routine
   void Test();
   virtual void SnapshotSolverState(SolverState* state) = 0;
@@ -6,6 +6,8 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+#include "caffe/util/memory_tracker.hpp"
 
 namespace caffe {
 
@@ -22,13 +24,15 @@ namespace caffe {
 // are constantly accessing them the memory pages almost always stays in
 // the physical memory (assuming we have large enough memory installed), and
 // does not seem to create a memory bottleneck here.
+//
+// The memory comes from the HostMemoryPool, which reuses freed blocks.
 
 inline void CaffeMallocHost(void** ptr, size_t size) {
-  *ptr = malloc(size);
+  *ptr = HostMemoryPool::Get().Allocate(size);
 }
 
-inline void CaffeFreeHost(void* ptr) {
-  free(ptr);
+inline void CaffeFreeHost(void* ptr, size_t size) {
+  HostMemoryPool::Get().Free(ptr, size);
 }
 
 
@@ -36,10 +40,10 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false) {}
+        own_cpu_data_(false), tracker_(), tracker_tag_(-1) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false) {}
+        own_cpu_data_(false), tracker_(), tracker_tag_(-1) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -49,6 +53,11 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  // True when set_cpu_data gave it memory owned elsewhere.
+  bool external_cpu_data() const { return cpu_ptr_ && !own_cpu_data_; }
+  // Counts the host memory this owns, now and when allocated, in tracker
+  // under tag, instead of the tracker it was counted in before.
+  void set_tracker(const shared_ptr<MemoryTracker>& tracker, int tag);
 
  private:
   void to_cpu();
@@ -58,6 +67,8 @@ class SyncedMemory {
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
+  shared_ptr<MemoryTracker> tracker_;
+  int tracker_tag_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
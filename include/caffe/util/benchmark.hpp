@@ -3,17 +3,25 @@
 #ifndef CAFFE_UTIL_BENCHMARK_H_
 #define CAFFE_UTIL_BENCHMARK_H_
 
-#include <boost/date_time/posix_time/posix_time.hpp>
 #include <cuda_runtime.h>
+#include <stdint.h>
 
 namespace caffe {
 
+// Microseconds on a monotonic clock, from an arbitrary origin. Before VS2015,
+// std::chrono::steady_clock is the coarse system clock, so MSVC reads the
+// performance counter instead.
+int64_t MonotonicMicros();
+
+// Measures elapsed time with CUDA events in GPU mode, and with a monotonic
+// clock of at least microsecond resolution in CPU mode.
 class Timer {
  public:
   Timer();
   virtual ~Timer();
   void Start();
   void Stop();
+  float MicroSeconds();
   float MilliSeconds();
   float Seconds();
 
@@ -29,9 +37,10 @@ class Timer {
   bool has_run_at_least_once_;
   cudaEvent_t start_gpu_;
   cudaEvent_t stop_gpu_;
-  boost::posix_time::ptime start_cpu_;
-  boost::posix_time::ptime stop_cpu_;
+  int64_t start_cpu_;
+  int64_t stop_cpu_;
   float elapsed_milliseconds_;
+  float elapsed_microseconds_;
 };
 
 }  // namespace caffe
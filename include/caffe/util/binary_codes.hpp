@@ -0,0 +1,90 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_BINARY_CODES_H_
+#define CAFFE_UTIL_BINARY_CODES_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+#if defined(_MSC_VER) && defined(__AVX__)
+#include <intrin.h>
+#endif
+
+using std::string;
+
+namespace caffe {
+
+// MSVC's __popcnt64 always emits the POPCNT instruction, which x86 CPUs
+// before SSE4.2 lack, so it is only used when building with /arch:AVX, whose
+// CPUs all have it; otherwise the bits are counted in parallel in the word.
+// GCC and Clang emit POPCNT only when building for a target that has it,
+// e.g. with -mpopcnt or -march=native, and otherwise call a slower library
+// routine.
+inline int popcount64(const uint64_t x) {
+#if defined(_MSC_VER) && defined(__AVX__)
+  return static_cast<int>(__popcnt64(x));
+#elif defined(_MSC_VER)
+  uint64_t v = x - ((x >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+#else
+  return __builtin_popcountll(x);
+#endif
+}
+
+// A table of binary codes, one per image, each packed into 64-bit words so
+// that Hamming distances are a few xors and popcounts. Bit i of a code is
+// set when feature i is above the threshold.
+class BinaryCodeTable {
+ public:
+  BinaryCodeTable() : num_codes_(0), num_bits_(0), words_per_code_(0) {}
+  virtual ~BinaryCodeTable() {}
+
+  // Replaces the table with the codes of rows of dim features each.
+  void Binarize(const float* features, const int rows, const int dim,
+      const float threshold);
+  // Packs a single row of num_bits() features the same way.
+  void BinarizeQuery(const float* features, const float threshold,
+      std::vector<uint64_t>* code) const;
+
+  // The file is a 24-byte header (magic "CBCT", version, num_codes,
+  // num_bits) followed by the packed words of every code.
+  void Write(const string& filename) const;
+  bool Read(const string& filename);
+
+  // Returns the k codes nearest to query as (distance, index) pairs,
+  // nearest first and ties broken by index. The table is scanned in one
+  // contiguous range per worker of pool, if given.
+  void Search(const uint64_t* query, const int k, WorkerPool* pool,
+      std::vector<std::pair<int, int> >* results) const;
+
+  inline int num_codes() const { return num_codes_; }
+  inline int num_bits() const { return num_bits_; }
+  inline int words_per_code() const { return words_per_code_; }
+  inline const uint64_t* code(const int index) const {
+    return &words_[static_cast<size_t>(index) * words_per_code_];
+  }
+
+ protected:
+  // Adds the k nearest codes in [begin, end) to results, unsorted.
+  void SearchRange(const uint64_t* query, const int k, const int begin,
+      const int end, std::vector<std::pair<int, int> >* results) const;
+
+  int num_codes_;
+  int num_bits_;
+  int words_per_code_;
+  std::vector<uint64_t> words_;
+
+  DISABLE_COPY_AND_ASSIGN(BinaryCodeTable);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_BINARY_CODES_H_
@@ -0,0 +1,66 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_BLOCKING_QUEUE_H_
+#define CAFFE_UTIL_BLOCKING_QUEUE_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// A minimal thread-safe FIFO. Pop() blocks until an element is available.
+// The prefetching data layers use a pair of these to pass batch slots back
+// and forth between the main thread and their worker thread.
+template <typename T>
+class BlockingQueue {
+ public:
+  BlockingQueue() {}
+
+  void Push(const T& t) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push(t);
+    }
+    condition_.notify_one();
+  }
+
+  T Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (queue_.empty()) {
+      condition_.wait(lock);
+    }
+    T t = queue_.front();
+    queue_.pop();
+    return t;
+  }
+
+  // Returns false instead of blocking if the queue is empty.
+  bool TryPop(T* t) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    *t = queue_.front();
+    queue_.pop();
+    return true;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+ private:
+  std::queue<T> queue_;
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+
+  DISABLE_COPY_AND_ASSIGN(BlockingQueue);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_BLOCKING_QUEUE_H_
@@ -0,0 +1,42 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_COMMAND_LINE_H_
+#define CAFFE_UTIL_COMMAND_LINE_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "caffe/common.hpp"
+
+using std::string;
+
+namespace caffe {
+
+// The optional "--name=value" arguments of a tool. The constructor removes
+// them from argv, so the tools keep reading their positional arguments by
+// index. A bare "--name" reads as "1".
+class CommandLineFlags {
+ public:
+  CommandLineFlags(int* argc, char** argv);
+  virtual ~CommandLineFlags() {}
+
+  bool Has(const string& name) const;
+  string GetString(const string& name, const string& default_value);
+  int GetInt(const string& name, const int default_value);
+  double GetDouble(const string& name, const double default_value);
+  bool GetBool(const string& name, const bool default_value);
+
+  // Fails on any flag that no Get call asked for, to catch misspellings.
+  void CheckAllUsed() const;
+
+ protected:
+  std::map<string, string> values_;
+  std::set<string> used_;
+
+  DISABLE_COPY_AND_ASSIGN(CommandLineFlags);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_COMMAND_LINE_H_
@@ -0,0 +1,38 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_DATA_TRANSFORM_H_
+#define CAFFE_UTIL_DATA_TRANSFORM_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// The mean subtraction and scaling shared by the data layers. SrcType is
+// uint8_t for Datum::data() and float for Datum::float_data(). The float
+// instantiations use SSE2, or AVX/AVX2 when the build enables them; double
+// falls back to scalar code.
+
+// dst[j] = (src[j * src_stride] - mean[j]) * scale for j in [0, n). If
+// mirror, the row is written to dst back to front.
+template <typename Dtype, typename SrcType>
+void caffe_transform_row(const int n, const SrcType* src, const int src_stride,
+    const Dtype* mean, const Dtype scale, const bool mirror, Dtype* dst);
+
+// dst[i] = (src[i] - mean[i]) * scale for a whole image of count values.
+template <typename Dtype, typename SrcType>
+void caffe_transform(const int count, const SrcType* src, const Dtype* mean,
+    const Dtype scale, Dtype* dst);
+
+// Crops the crop_height x crop_width window at (h_off, w_off) out of the
+// channels x height x width image src, subtracts the matching window of mean
+// (same shape as src), scales, and writes the channels x crop_height x
+// crop_width result to dst, flipped horizontally if mirror.
+template <typename Dtype, typename SrcType>
+void caffe_transform_crop(const int channels, const int height,
+    const int width, const int h_off, const int w_off, const int crop_height,
+    const int crop_width, const bool mirror, const SrcType* src,
+    const Dtype* mean, const Dtype scale, Dtype* dst);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATA_TRANSFORM_H_
@@ -0,0 +1,85 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_DB_H_
+#define CAFFE_UTIL_DB_H_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+namespace db {
+
+enum Mode { READ, WRITE, NEW };
+
+// Walks the records of a DB in key order.
+class Cursor {
+ public:
+  Cursor() {}
+  virtual ~Cursor() {}
+  virtual void SeekToFirst() = 0;
+  virtual void SeekToLast() = 0;
+  // Moves to the first record whose key is not less than key, and returns
+  // valid().
+  virtual bool Seek(const std::string& key) = 0;
+  virtual void Next() = 0;
+  virtual bool valid() const = 0;
+  virtual std::string key() const = 0;
+  // The current value, pointing into the backend's own storage, so that it
+  // can be parsed with ParseFromArray without a copy. It is only valid until
+  // the cursor moves, unless values_stable().
+  virtual const char* value_data() const = 0;
+  virtual size_t value_size() const = 0;
+  // True if value_data() stays valid after the cursor moves on, as it does
+  // for LMDB's memory map for as long as the cursor exists.
+  virtual bool values_stable() const { return false; }
+  std::string value() const {
+    return std::string(value_data(), value_size());
+  }
+
+  DISABLE_COPY_AND_ASSIGN(Cursor);
+};
+
+// Buffers writes until Commit().
+class Transaction {
+ public:
+  Transaction() {}
+  virtual ~Transaction() {}
+  virtual void Put(const std::string& key, const std::string& value) = 0;
+  virtual void Commit() = 0;
+
+  DISABLE_COPY_AND_ASSIGN(Transaction);
+};
+
+class DB {
+ public:
+  DB() {}
+  virtual ~DB() {}
+  virtual void Open(const std::string& source, Mode mode) = 0;
+  virtual void Close() = 0;
+  // The caller owns the returned cursor or transaction, and must delete it
+  // before closing the DB.
+  virtual Cursor* NewCursor() = 0;
+  virtual Transaction* NewTransaction() = 0;
+
+  DISABLE_COPY_AND_ASSIGN(DB);
+};
+
+// Returns a new, unopened DB of the given backend.
+DB* GetDB(DataParameter::DB backend);
+// Accepts "leveldb" or "lmdb", for the command line tools.
+DB* GetDB(const std::string& backend);
+
+// Returns a key fraction of the way from first to last, to seek to. Past
+// their common prefix, keys that both continue with as many decimal digits,
+// like the zero padded indices convert_imageset writes, are interpolated as
+// numbers, and other keys as base-256 numbers of their next six bytes.
+// The key is never past last.
+std::string InterpolateKey(const std::string& first, const std::string& last,
+    double fraction);
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_H_
@@ -0,0 +1,58 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_FEATURE_MATRIX_H_
+#define CAFFE_UTIL_FEATURE_MATRIX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+using std::string;
+
+namespace caffe {
+
+// A feature matrix file is this header, in little-endian byte order,
+// followed by rows * cols float32 values in row-major order. The data
+// starts at a fixed 24-byte offset, so readers can memory map the file
+// instead of parsing it.
+struct FeatureMatrixHeader {
+  char magic[4];  // "CFMX"
+  uint32_t version;
+  uint64_t rows;
+  uint64_t cols;
+};
+
+// Writes a feature matrix a few rows at a time. The row count in the header
+// is filled in by Close.
+class FeatureMatrixWriter {
+ public:
+  FeatureMatrixWriter(const string& filename, const int cols);
+  virtual ~FeatureMatrixWriter();
+
+  void AppendRows(const float* data, const int num_rows);
+  void Close();
+
+  inline uint64_t rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+
+ protected:
+  FILE* file_;
+  string filename_;
+  uint64_t rows_;
+  const int cols_;
+
+  DISABLE_COPY_AND_ASSIGN(FeatureMatrixWriter);
+};
+
+// Reads a whole feature matrix file; returns false if it cannot be opened
+// or is not a feature matrix.
+bool ReadFeatureMatrix(const string& filename, uint64_t* rows, int* cols,
+    std::vector<float>* data);
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_FEATURE_MATRIX_H_
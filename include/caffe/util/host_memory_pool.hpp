@@ -0,0 +1,79 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_H_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace caffe {
+
+using std::vector;
+
+// Hands out host memory rounded up to a size class, and keeps freed blocks
+// to serve later requests of the same class without going to the system.
+// Classes are four per power of two, so at most a quarter of a block is
+// unused. Blocks are aligned to kAlignment bytes, and blocks of at least
+// kHugePageSize can be backed by huge pages where the system supports it.
+// It may be used from several threads.
+class HostMemoryPool {
+ public:
+  struct Stats {
+    // Allocations served by a held block, and by the system.
+    uint64_t hits;
+    uint64_t misses;
+    // Bytes of the blocks handed out, and of the freed blocks held.
+    size_t bytes_in_use;
+    size_t bytes_held;
+    // The most bytes_in_use has been.
+    size_t peak_bytes_in_use;
+  };
+
+  static const size_t kAlignment = 64;
+  static const size_t kHugePageSize = 2 << 20;
+
+  // The pool behind CaffeMallocHost and CaffeFreeHost. It is never
+  // destroyed, so that memory can be freed during static destruction.
+  static HostMemoryPool& Get();
+  // The size of the blocks that serve a request of size bytes.
+  static size_t SizeClass(size_t size);
+
+  HostMemoryPool();
+  ~HostMemoryPool();
+
+  void* Allocate(size_t size);
+  // size is the size ptr was allocated with.
+  void Free(void* ptr, size_t size);
+  // Aligns the blocks of at least kHugePageSize allocated from now on to it,
+  // and asks the system to back them with huge pages. Only Linux honors it.
+  void set_huge_pages(bool huge_pages);
+  // Freed blocks are returned to the system once the pool holds this many
+  // bytes. By default the limit is a quarter of the peak bytes in use, so
+  // that a long-running process does not keep its peak memory for good.
+  void set_max_held_bytes(size_t max_held_bytes);
+  // Returns every held block to the system, e.g. once a net is destroyed.
+  void Trim();
+  Stats stats();
+  void LogStats();
+
+ private:
+  void* SystemAllocate(size_t size);
+  static void SystemFree(void* ptr);
+
+  std::mutex mutex_;
+  // Held blocks by size class.
+  std::map<size_t, vector<void*> > held_;
+  Stats stats_;
+  bool huge_pages_;
+  // Whether set_max_held_bytes has replaced the default limit.
+  bool max_held_bytes_set_;
+  size_t max_held_bytes_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_H_
@@ -0,0 +1,63 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_IMAGE_CACHE_H_
+#define CAFFE_UTIL_IMAGE_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// A thread-safe LRU cache of decoded images, keyed by an index into the
+// layer's list of images and bounded by the bytes of image data it holds.
+// The data layers keep it across epochs, so that images which fit are read
+// and decoded only once.
+class ImageCache {
+ public:
+  explicit ImageCache(const size_t max_bytes);
+  virtual ~ImageCache() {}
+
+  // Returns the cached image and marks it most recently used, or returns an
+  // empty pointer on a miss.
+  shared_ptr<const Datum> Get(const int key);
+  // Inserts the image, evicting the least recently used ones until it fits.
+  // An image larger than the whole budget is not cached.
+  void Put(const int key, const shared_ptr<const Datum>& image);
+
+  size_t max_bytes() const { return max_bytes_; }
+  size_t bytes() const;
+  int size() const;
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t evictions() const;
+
+ protected:
+  static size_t ImageBytes(const Datum& image);
+  void Evict();
+
+  typedef std::list<int> LRUList;
+  typedef std::pair<shared_ptr<const Datum>, LRUList::iterator> Entry;
+
+  const size_t max_bytes_;
+  mutable std::mutex mutex_;
+  // Keys from the most to the least recently used.
+  LRUList lru_;
+  std::map<int, Entry> entries_;
+  size_t bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_IMAGE_CACHE_H_
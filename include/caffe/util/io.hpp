@@ -67,6 +67,14 @@ inline bool ReadImageToDatum(const string& filename, const int label,
     Datum* datum) {
   return ReadImageToDatum(filename, label, 32, 32, datum);//lipengyu changged 0,0 to 32,32
 }
+
+// Stores the file's bytes, still encoded, in datum.data and marks the datum
+// encoded, so that it is decoded when read.
+bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
+
+// Decodes the image of an encoded datum in place, resizing it to height x
+// width if both are positive. The label is kept.
+bool DecodeDatum(const int height, const int width, Datum* datum);
 /*
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
@@ -0,0 +1,63 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_MEMORY_TRACKER_H_
+#define CAFFE_UTIL_MEMORY_TRACKER_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caffe {
+
+using std::string;
+using std::vector;
+
+// Counts the host memory allocated by the SyncedMemory tagged with it, per
+// owner (a layer or blob name) and kind, as well as its total and peak. Each
+// Net has one; memory shared between nets is counted by the net that tagged
+// it last. It may be updated from several threads.
+class MemoryTracker {
+ public:
+  enum Kind { DATA, DIFF, PARAM, WORKSPACE, HISTORY, PREFETCH };
+  static const int kNumKinds = PREFETCH + 1;
+  static const char* KindName(Kind kind);
+
+  struct Entry {
+    string owner;
+    Kind kind;
+    size_t current_bytes;
+    size_t peak_bytes;
+  };
+
+  MemoryTracker() : current_bytes_(0), peak_bytes_(0) {}
+
+  // Returns the tag under which the memory of this owner and kind is
+  // counted, the same for every call with the same owner and kind.
+  int Register(const string& owner, Kind kind);
+  void Allocate(int tag, size_t bytes);
+  void Free(int tag, size_t bytes);
+
+  size_t current_bytes();
+  size_t peak_bytes();
+  size_t current_bytes(Kind kind);
+  // A snapshot of the counts of every owner and kind, in registration order.
+  vector<Entry> entries();
+  // Logs the current and peak totals, the total of each kind, and the
+  // num_owners owners currently holding the most memory.
+  void Log(const string& name, int num_owners = 10);
+
+ private:
+  std::mutex mutex_;
+  std::map<std::pair<string, int>, int> tags_;
+  vector<Entry> entries_;
+  size_t current_bytes_;
+  size_t peak_bytes_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MEMORY_TRACKER_H_
@@ -0,0 +1,96 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_TRACE_H_
+#define CAFFE_UTIL_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+using std::string;
+
+// Records timed spans into one ring buffer per thread, and writes them in the
+// Chrome trace event format (load the file in chrome://tracing). Tracing is
+// compiled in but disabled by default, where a span costs a single load of
+// an atomic flag. Each thread keeps its most recent buffer_size() spans, in
+// a buffer that grows as they are recorded and is handed on to a later
+// thread once it calls ReleaseThreadBuffer, which the threads caffe starts
+// do through a TraceThread before they exit.
+// In GPU mode, the spans time the kernel launches, not their execution.
+class Tracer {
+ public:
+  static void Enable();
+  static void Disable();
+  inline static bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Spans kept per thread; applies to the buffers of threads that have not
+  // recorded anything yet.
+  static void set_buffer_size(int buffer_size);
+  static int buffer_size();
+  // Hands the buffer of the calling thread on to the next thread that records
+  // a span; the spans in it are kept.
+  static void ReleaseThreadBuffer();
+  // Microseconds on a monotonic clock, since the first call.
+  static int64_t NowMicros();
+  // Records a span of the calling thread. name is copied, truncated to
+  // kMaxNameLength characters; category must be a string literal.
+  static void Record(const char* name, const char* category,
+      int64_t begin_us, int64_t end_us);
+  // The number of spans held in all the buffers.
+  static int num_events();
+  // Writes the spans of every thread, oldest first, and returns false if the
+  // file cannot be written.
+  static bool WriteChromeTrace(const string& filename);
+  // Drops every recorded span.
+  static void Clear();
+
+  static const int kMaxNameLength = 63;
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+// Records the span between its construction and destruction if tracing was
+// enabled at construction.
+class TraceScope {
+ public:
+  inline TraceScope(const char* name, const char* category)
+      : name_(name), category_(category), begin_us_(-1) {
+    if (Tracer::enabled()) {
+      begin_us_ = Tracer::NowMicros();
+    }
+  }
+  inline ~TraceScope() {
+    if (begin_us_ >= 0) {
+      Tracer::Record(name_, category_, begin_us_, Tracer::NowMicros());
+    }
+  }
+
+ private:
+  const char* name_;
+  const char* category_;
+  int64_t begin_us_;
+
+  DISABLE_COPY_AND_ASSIGN(TraceScope);
+};
+
+// Releases the trace buffer of its thread on destruction. Declared first in
+// the function a thread runs, so that it outlives the TraceScopes in it.
+class TraceThread {
+ public:
+  inline TraceThread() {}
+  inline ~TraceThread() { Tracer::ReleaseThreadBuffer(); }
+
+ private:
+  DISABLE_COPY_AND_ASSIGN(TraceThread);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRACE_H_
@@ -0,0 +1,63 @@
+// Copyright 2014 BVLC and contributors.
+
+#ifndef CAFFE_UTIL_WORKER_POOL_H_
+#define CAFFE_UTIL_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+// A fixed set of threads that split the items of a batch between them. The
+// data layers call Run from their prefetch thread to decode and transform a
+// batch in parallel.
+class WorkerPool {
+ public:
+  // Called once per item with the item index and the calling worker's rng.
+  typedef std::function<void(int item_id, rng_t* rng)> ItemFunction;
+
+  // Worker 0 is the thread calling Run, so num_workers - 1 threads are
+  // started.
+  explicit WorkerPool(const int num_workers);
+  virtual ~WorkerPool();
+
+  // Calls item_fn for every item in [0, num_items) and returns once all are
+  // done. Each worker takes one contiguous range of items. Before every item
+  // the worker's rng is reseeded with seed + item_id, so the results depend
+  // only on seed, not on num_workers or on scheduling.
+  void Run(const int num_items, const unsigned int seed,
+      const ItemFunction& item_fn);
+
+  inline int num_workers() const { return num_workers_; }
+
+ protected:
+  void WorkerLoop(const int worker_id);
+  void RunRange(const int worker_id);
+
+  const int num_workers_;
+  std::vector<std::thread> threads_;
+  std::vector<shared_ptr<rng_t> > rngs_;
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  // Incremented by Run to wake the workers for a new batch.
+  unsigned int generation_;
+  int num_pending_;
+  bool stop_;
+  // The current batch; only valid while a Run is in progress.
+  int num_items_;
+  unsigned int seed_;
+  const ItemFunction* item_fn_;
+
+  DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_WORKER_POOL_H_
@@ -8,8 +8,9 @@
 #include <vector>
 #include <fstream>
 
-#include "leveldb/db.h"
 //#include "pthread.h"
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include "boost/scoped_ptr.hpp"
 //#include "hdf5.h"
@@ -18,10 +19,18 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 #define HDF5_DATA_DATASET_NAME "data"
 #define HDF5_DATA_LABEL_NAME "label"
 
+namespace cv {
+class Mat;
+}
+
 namespace caffe {
 
 
@@ -284,7 +293,8 @@ class ConvolutionLayer : public Layer<Dtype> {
   int N_;
 };
 
-// This function is used to create a pthread that prefetches the data.
+// This function is run by the long-lived thread that keeps the prefetch ring
+// of a DataLayer filled.
 template <typename Dtype>
 void* DataLayerPrefetch(void* layer_pointer);
 
@@ -299,6 +309,8 @@ class DataLayer : public Layer<Dtype> {
   virtual ~DataLayer();
   virtual void SetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
+  virtual bool GetDataCursor(DataCursor* cursor);
+  virtual void SeekDataCursor(const DataCursor& cursor);
 
  protected:
   virtual Dtype Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -313,20 +325,74 @@ class DataLayer : public Layer<Dtype> {
   virtual void CreatePrefetchThread();
   virtual void JoinPrefetchThread();
   virtual unsigned int PrefetchRand();
+  // Fills prefetch slot with the next batch; runs on the prefetch thread.
+  virtual void PrefetchBatch(const int slot);
+  // Parses and transforms one record of the batch; runs on a worker.
+  virtual void PrefetchItem(const int item_id, const Caffe::Phase phase,
+      rng_t* rng, Dtype* top_data, Dtype* top_label);
+  // Queues slot for refilling by the prefetch thread.
+  virtual void RecyclePrefetchSlot(const int slot);
+  // Moves the cursor to the next record, wrapping around at the end of the
+  // DB or of the shard.
+  virtual void AdvanceCursor();
+  // Moves the cursor to the first record of the shard.
+  virtual void SeekToShard();
+  // Fills keys_ from the key_index_file, or by scanning the DB, and picks out
+  // the range of them in this shard.
+  virtual void BuildKeyIndex();
+  // Looks up the next shuffle_readahead records of the epoch's permutation.
+  virtual void ReadAhead();
+  // Permutes the shard's keys into shuffle_order_ by shuffle_seed_.
+  virtual void ShuffleKeys();
+  // Records where the next batch would start reading.
+  virtual void GetReadPosition(DataCursor* cursor);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
-  shared_ptr<leveldb::DB> db_;
-  shared_ptr<leveldb::Iterator> iter_;
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Cursor> cursor_;
+  // With shuffle or shards, every key of the DB in key order, of which this
+  // shard reads shard_size_ from shard_begin_. Sequential reads count the
+  // records read from the shard in shard_pos_. Shuffled reads permute the
+  // shard's keys in shuffle_order_, and have read it this epoch up to
+  // shuffle_pos_.
+  vector<std::string> keys_;
+  int shard_begin_;
+  int shard_size_;
+  int shard_pos_;
+  vector<int> shuffle_order_;
+  unsigned int shuffle_seed_;
+  int shuffle_pos_;
+  // The records looked up by ReadAhead and not yet batched, from
+  // readahead_pos_ on. Values are copied into readahead_values_ unless the
+  // DB's values are stable.
+  vector<std::pair<const char*, size_t> > readahead_records_;
+  vector<std::string> readahead_values_;
+  int readahead_pos_;
   int datum_channels_;
   int datum_height_;
   int datum_width_;
   int datum_size_;
   std::thread thread_;
-  shared_ptr<Blob<Dtype> > prefetch_data_;
-  shared_ptr<Blob<Dtype> > prefetch_label_;
+  // The prefetch ring: prefetch_depth batch slots circulate from
+  // prefetch_free_ through the prefetch thread to prefetch_full_, and Forward
+  // swaps a full slot's buffers into the top blobs before recycling it.
+  vector<shared_ptr<Blob<Dtype> > > prefetch_data_;
+  vector<shared_ptr<Blob<Dtype> > > prefetch_label_;
+  // The phase each slot should be filled for, set when the slot is queued.
+  vector<Caffe::Phase> prefetch_phase_;
+  // The read position after each slot's batch, and after the last batch
+  // handed to Forward.
+  vector<DataCursor> prefetch_cursor_;
+  DataCursor data_cursor_;
+  BlockingQueue<int> prefetch_free_;
+  BlockingQueue<int> prefetch_full_;
+  // The serialized records of the batch being prefetched. Records point
+  // into the DB when its values are stable, and into values otherwise.
+  vector<std::pair<const char*, size_t> > prefetch_records_;
+  vector<std::string> prefetch_values_;
+  shared_ptr<WorkerPool> workers_;
   Blob<Dtype> data_mean_;
   bool output_labels_;
-  Caffe::Phase phase_;
 };
 
 template <typename Dtype>
@@ -448,7 +514,7 @@ template <typename Dtype>
 class HingeLossLayer : public Layer<Dtype> {
  public:
   explicit HingeLossLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), margins_() {}
   virtual void SetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
 
@@ -461,6 +527,10 @@ class HingeLossLayer : public Layer<Dtype> {
       const bool propagate_down, vector<Blob<Dtype>*>* bottom);
   // virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
   //     const bool propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  // The hinge margins of the last Forward, kept out of the bottom diff,
+  // which an inference_only net does not allocate.
+  Blob<Dtype> margins_;
 };
 
 template <typename Dtype>
@@ -504,6 +574,10 @@ class ImageDataLayer : public Layer<Dtype> {
   virtual ~ImageDataLayer();
   virtual void SetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
+  virtual bool GetDataCursor(DataCursor* cursor);
+  virtual void SeekDataCursor(const DataCursor& cursor);
+  // NULL unless cache_size_mb is set.
+  const ImageCache* cache() const { return cache_.get(); }
 
  protected:
   virtual Dtype Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -515,15 +589,34 @@ class ImageDataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const bool propagate_down, vector<Blob<Dtype>*>* bottom) { return; }
 
+  // Draws a seed for a new epoch, and permutes the lines by it.
   virtual void ShuffleImages();
+  // Orders line_order_ by shuffle_seed_.
+  virtual void PermuteLines();
 
   virtual void CreatePrefetchThread();
   virtual void JoinPrefetchThread();
   virtual unsigned int PrefetchRand();
+  // Loads and transforms one image of the batch; runs on a worker.
+  virtual void PrefetchItem(const int item_id, rng_t* rng, Dtype* top_data,
+      Dtype* top_label);
+  // Returns the decoded image of lines_[line_id], from the cache if it holds
+  // it, or an empty pointer if it cannot be read.
+  shared_ptr<const Datum> ReadImage(const int line_id);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
+  // The lines of the source, read in the order of line_order_.
   vector<std::pair<std::string, int> > lines_;
+  vector<int> line_order_;
+  unsigned int shuffle_seed_;
   int lines_id_;
+  // Where the batch being prefetched, the next one Forward returns, starts.
+  DataCursor data_cursor_;
+  // The indices into lines_ of the batch being prefetched.
+  vector<int> prefetch_lines_;
+  shared_ptr<WorkerPool> workers_;
+  // Decoded images by index into lines_; NULL unless cache_size_mb is set.
+  shared_ptr<ImageCache> cache_;
   int datum_channels_;
   int datum_height_;
   int datum_width_;
@@ -658,10 +751,16 @@ class MemoryDataLayer : public Layer<Dtype> {
   // Reset should accept const pointers, but can't, because the memory
   //  will be given to Blob, which is mutable
   void Reset(Dtype* data, Dtype* label, int n);
+  // Copies one sample into the queue, blocking while it is full. Safe to
+  // call from several threads; cannot be mixed with Reset.
+  void Push(const Dtype* data, Dtype label);
   int datum_channels() { return datum_channels_; }
   int datum_height() { return datum_height_; }
   int datum_width() { return datum_width_; }
   int batch_size() { return batch_size_; }
+  // Number of real samples in the last batch taken from the queue; the
+  // rest of a partial batch is zero filled.
+  int last_batch_size() { return last_batch_size_; }
 
  protected:
   virtual Dtype Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -680,6 +779,19 @@ class MemoryDataLayer : public Layer<Dtype> {
   int batch_size_;
   int n_;
   int pos_;
+  // Ring buffer of pushed samples, allocated on the first Push.
+  vector<Dtype> queue_data_;
+  vector<Dtype> queue_labels_;
+  // When every queued sample was pushed, in MonotonicMicros, for the timeout.
+  vector<int64_t> queue_push_times_;
+  int queue_capacity_;
+  int queue_head_;
+  int queue_count_;
+  int timeout_ms_;
+  int last_batch_size_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_not_empty_;
+  std::condition_variable queue_not_full_;
 };
 
 template <typename Dtype>
@@ -835,16 +947,36 @@ class WindowDataLayer : public Layer<Dtype> {
   virtual void CreatePrefetchThread();
   virtual void JoinPrefetchThread();
   virtual unsigned int PrefetchRand();
+  // Picks the window and mirroring of one item of the batch.
+  virtual void SampleWindow(const int item_id, rng_t* rng);
+  // Loads the image of image_database_[image_index] into cv_img, from the
+  // cache if it holds it. The image shares its pixels with the cache entry
+  // held by cached, and must not be written to.
+  virtual bool LoadImage(const int image_index, cv::Mat* cv_img,
+      shared_ptr<const Datum>* cached);
+  // Crops the sampled window of the item out of its image and warps it into
+  // the batch.
+  virtual void WarpWindow(const int item_id, const cv::Mat& cv_img,
+      Dtype* top_data, Dtype* top_label);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   std::thread thread_;
   shared_ptr<Blob<Dtype> > prefetch_data_;
   shared_ptr<Blob<Dtype> > prefetch_label_;
+  shared_ptr<WorkerPool> workers_;
   Blob<Dtype> data_mean_;
   vector<std::pair<std::string, vector<int> > > image_database_;
   enum WindowField { IMAGE_INDEX, LABEL, OVERLAP, X1, Y1, X2, Y2, NUM };
   vector<vector<float> > fg_windows_;
   vector<vector<float> > bg_windows_;
+  // The sampled window and mirroring of every item of the batch being
+  // prefetched.
+  vector<const vector<float>*> batch_windows_;
+  vector<int> batch_mirror_;
+  // With group_by_image, the items of the batch grouped by image.
+  vector<vector<int> > batch_groups_;
+  // Decoded images by image index; NULL unless cache_size_mb is set.
+  shared_ptr<ImageCache> cache_;
 };
 
 
@@ -25,6 +25,7 @@
 
 
 using namespace caffe;  // NOLINT(build/namespaces)
+using boost::python::dict;
 using boost::python::extract;
 using boost::python::len;
 using boost::python::list;
@@ -289,7 +290,10 @@ struct CaffeNet {
   }
 
   void ForwardPrefilled() {
+    // Let other python threads push samples while a MemoryDataLayer waits.
+    Py_BEGIN_ALLOW_THREADS
     net_->ForwardPrefilled();
+    Py_END_ALLOW_THREADS
   }
 
   void set_input_arrays(object data_obj, object labels_obj) {
@@ -327,17 +331,55 @@ struct CaffeNet {
         PyArray_DIMS(data_arr)[0]);
   }
 
+  void push_input_arrays(object data_obj, object labels_obj) {
+    shared_ptr<MemoryDataLayer<float> > md_layer =
+      boost::dynamic_pointer_cast<MemoryDataLayer<float> >(net_->layers()[0]);
+    if (!md_layer) {
+      throw std::runtime_error("push_input_arrays may only be called if the"
+          " first layer is a MemoryDataLayer");
+    }
+    PyArrayObject* data_arr =
+        reinterpret_cast<PyArrayObject*>(data_obj.ptr());
+    PyArrayObject* labels_arr =
+        reinterpret_cast<PyArrayObject*>(labels_obj.ptr());
+    check_contiguous_array(data_arr, "data array", md_layer->datum_channels(),
+        md_layer->datum_height(), md_layer->datum_width());
+    check_contiguous_array(labels_arr, "labels array", 1, 1, 1);
+    if (PyArray_DIMS(data_arr)[0] != PyArray_DIMS(labels_arr)[0]) {
+      throw std::runtime_error("data and labels must have the same first"
+          " dimension");
+    }
+    const float* data = static_cast<float*>(PyArray_DATA(data_arr));
+    const float* labels = static_cast<float*>(PyArray_DATA(labels_arr));
+    const int num = PyArray_DIMS(data_arr)[0];
+    const int datum_size = md_layer->datum_channels() *
+        md_layer->datum_height() * md_layer->datum_width();
+    // Push copies each sample, so the arrays need not outlive this call;
+    // the GIL is released while the queue is full.
+    Py_BEGIN_ALLOW_THREADS
+    for (int i = 0; i < num; ++i) {
+      md_layer->Push(data + i * datum_size, labels[i]);
+    }
+    Py_END_ALLOW_THREADS
+  }
+
   // The caffe::Caffe utility functions.
   void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
   void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
   void set_phase_train() { Caffe::set_phase(Caffe::TRAIN); }
   void set_phase_test() { Caffe::set_phase(Caffe::TEST); }
   void set_device(int device_id) { Caffe::SetDevice(device_id); }
+  // Returns the host memory held for reuse to the system, e.g. after
+  // dropping a net.
+  void trim_host_memory() { HostMemoryPool::Get().Trim(); }
 
+  // Goes through blob_by_name, so that with share_activations each blob gets
+  // its own memory and keeps its data past the Forward of later blobs.
   vector<CaffeBlob> blobs() {
     vector<CaffeBlob> result;
     for (int i = 0; i < net_->blobs().size(); ++i) {
-      result.push_back(CaffeBlob(net_->blobs()[i], net_->blob_names()[i]));
+      const string& name = net_->blob_names()[i];
+      result.push_back(CaffeBlob(net_->blob_by_name(name), name));
     }
     return result;
   }
@@ -350,6 +392,53 @@ struct CaffeNet {
     return result;
   }
 
+  bool profiling() { return net_->profiling(); }
+  void set_profiling(bool profiling) { net_->set_profiling(profiling); }
+  void reset_profile() { net_->ResetProfile(); }
+
+  // One dict per layer, in net order.
+  list profile() {
+    list result;
+    const vector<LayerProfile>& profiles = net_->layer_profiles();
+    for (int i = 0; i < profiles.size(); ++i) {
+      dict layer;
+      layer["name"] = net_->layer_names()[i];
+      const PassProfile* passes[] = { &profiles[i].forward,
+                                      &profiles[i].backward };
+      const char* pass_names[] = { "forward", "backward" };
+      for (int p = 0; p < 2; ++p) {
+        const string prefix(pass_names[p]);
+        layer[prefix + "_count"] = passes[p]->count;
+        layer[prefix + "_total_ms"] = passes[p]->total_ms;
+        layer[prefix + "_min_ms"] = passes[p]->min_ms;
+        layer[prefix + "_max_ms"] = passes[p]->max_ms;
+      }
+      layer["top_bytes"] = profiles[i].top_bytes;
+      result.append(layer);
+    }
+    return result;
+  }
+
+  // The host memory totals, and one dict per owner and kind.
+  dict memory() {
+    MemoryTracker* tracker = net_->memory_tracker().get();
+    dict result;
+    result["current_bytes"] = tracker->current_bytes();
+    result["peak_bytes"] = tracker->peak_bytes();
+    list entries;
+    const vector<MemoryTracker::Entry> tracked = tracker->entries();
+    for (int i = 0; i < tracked.size(); ++i) {
+      dict entry;
+      entry["owner"] = tracked[i].owner;
+      entry["kind"] = MemoryTracker::KindName(tracked[i].kind);
+      entry["current_bytes"] = tracked[i].current_bytes;
+      entry["peak_bytes"] = tracked[i].peak_bytes;
+      entries.append(entry);
+    }
+    result["entries"] = entries;
+    return result;
+  }
+
   // The pointer to the internal caffe::Net instant.
   shared_ptr<Net<float> > net_;
   // if taking input from an ndarray, we need to hold references
@@ -397,9 +486,16 @@ BOOST_PYTHON_MODULE(_caffe) {
       .def("set_phase_train",   &CaffeNet::set_phase_train)
       .def("set_phase_test",    &CaffeNet::set_phase_test)
       .def("set_device",        &CaffeNet::set_device)
+      .def("trim_host_memory",  &CaffeNet::trim_host_memory)
       .add_property("_blobs",   &CaffeNet::blobs)
       .add_property("layers",   &CaffeNet::layers)
-      .def("_set_input_arrays", &CaffeNet::set_input_arrays);
+      .add_property("profiling", &CaffeNet::profiling,
+                    &CaffeNet::set_profiling)
+      .def("_profile",          &CaffeNet::profile)
+      .def("reset_profile",     &CaffeNet::reset_profile)
+      .def("memory",            &CaffeNet::memory)
+      .def("_set_input_arrays", &CaffeNet::set_input_arrays)
+      .def("_push_input_arrays", &CaffeNet::push_input_arrays);
 
   boost::python::class_<CaffeBlob, CaffeBlobWrap>(
       "Blob", boost::python::no_init)
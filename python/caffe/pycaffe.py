@@ -16,7 +16,8 @@ from ._caffe import Net, SGDSolver
 def _Net_blobs(self):
     """
     An OrderedDict (bottom to top, i.e., input to output) of network
-    blobs indexed by name
+    blobs indexed by name. In a net with share_activations, this gives every
+    blob its own memory again.
     """
     return OrderedDict([(bl.name, bl) for bl in self._blobs])
 
@@ -34,6 +35,17 @@ def _Net_params(self):
 
 Net.params = _Net_params
 
+@property
+def _Net_profile(self):
+    """
+    An OrderedDict (bottom to top) of the per-layer call counts, times in
+    milliseconds and top bytes recorded since profiling was enabled or
+    reset_profile was called; set profiling = True to record them
+    """
+    return OrderedDict([(lr['name'], lr) for lr in self._profile()])
+
+Net.profile = _Net_profile
+
 def _Net_set_input_arrays(self, data, labels):
     if labels.ndim == 1:
         labels = np.ascontiguousarray(labels[:, np.newaxis, np.newaxis,
@@ -41,3 +53,16 @@ def _Net_set_input_arrays(self, data, labels):
     return self._set_input_arrays(data, labels)
 
 Net.set_input_arrays = _Net_set_input_arrays
+
+def _Net_push_input_arrays(self, data, labels):
+    """
+    Queue samples on the input MemoryDataLayer, blocking while its queue
+    is full. May be called from several threads.
+    """
+    labels = np.asarray(labels, dtype=np.float32)
+    if labels.ndim == 1:
+        labels = np.ascontiguousarray(labels[:, np.newaxis, np.newaxis,
+                                             np.newaxis])
+    return self._push_input_arrays(data, labels)
+
+Net.push_input_arrays = _Net_push_input_arrays
@@ -22,15 +22,35 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
   height_ = height;
   width_ = width;
   count_ = num_ * channels_ * height_ * width_;
-  if (count_) {
-    data_.reset(new SyncedMemory(count_ * sizeof(Dtype)));
-    diff_.reset(new SyncedMemory(count_ * sizeof(Dtype)));
-  } else {
+  if (!count_) {
     data_.reset(reinterpret_cast<SyncedMemory*>(NULL));
     diff_.reset(reinterpret_cast<SyncedMemory*>(NULL));
+    return;
+  }
+  // Only grow: memory that is large enough is kept, contents and all, as
+  // long as this blob alone uses it.
+  const size_t size = count_ * sizeof(Dtype);
+  if (!Reusable(data_, size)) {
+    data_.reset(new SyncedMemory(size));
+    if (memory_tracker_) {
+      data_->set_tracker(memory_tracker_, data_tag_);
+    }
+  }
+  if (diff_enabled_ && !Reusable(diff_, size)) {
+    diff_.reset(new SyncedMemory(size));
+    if (memory_tracker_) {
+      diff_->set_tracker(memory_tracker_, diff_tag_);
+    }
   }
 }
 
+template <typename Dtype>
+bool Blob<Dtype>::Reusable(const shared_ptr<SyncedMemory>& memory,
+    const size_t size) {
+  return memory && memory.unique() && !memory->external_cpu_data() &&
+      memory->size() >= size;
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.num(), other.channels(), other.height(), other.width());
@@ -38,7 +58,8 @@ void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
-    const int width) {
+    const int width)
+    : diff_enabled_(true), memory_tracker_(), data_tag_(-1), diff_tag_(-1) {
   Reshape(num, channels, height, width);
 }
 
@@ -62,14 +83,12 @@ const Dtype* Blob<Dtype>::gpu_data() const {
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
-  CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data();
+  return (const Dtype*)diff()->cpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
-  CHECK(diff_);
-  return (const Dtype*)diff_->gpu_data();
+  return (const Dtype*)diff()->gpu_data();
 }
 
 template <typename Dtype>
@@ -86,14 +105,12 @@ Dtype* Blob<Dtype>::mutable_gpu_data() {
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
-  CHECK(diff_);
-  return reinterpret_cast<Dtype*>(diff_->mutable_cpu_data());
+  return reinterpret_cast<Dtype*>(diff()->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
-  CHECK(diff_);
-  return reinterpret_cast<Dtype*>(diff_->mutable_gpu_data());
+  return reinterpret_cast<Dtype*>(diff()->mutable_gpu_data());
 }
 
 template <typename Dtype>
@@ -105,9 +122,45 @@ void Blob<Dtype>::ShareData(const Blob& other) {
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(diff_enabled_) << "The diff of this blob is disabled.";
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::SwapData(Blob* other) {
+  CHECK(other);
+  CHECK_EQ(count_, other->count());
+  data_.swap(other->data_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_data(const shared_ptr<SyncedMemory>& buffer) {
+  CHECK_GE(buffer->size(), count_ * sizeof(Dtype));
+  data_ = buffer;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::DisableDiff() {
+  diff_enabled_ = false;
+  diff_.reset(reinterpret_cast<SyncedMemory*>(NULL));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::TrackMemory(const shared_ptr<MemoryTracker>& tracker,
+    const string& owner, MemoryTracker::Kind data_kind,
+    MemoryTracker::Kind diff_kind) {
+  CHECK(tracker);
+  memory_tracker_ = tracker;
+  data_tag_ = tracker->Register(owner, data_kind);
+  diff_tag_ = tracker->Register(owner, diff_kind);
+  if (data_) {
+    data_->set_tracker(memory_tracker_, data_tag_);
+  }
+  if (diff_) {
+    diff_->set_tracker(memory_tracker_, diff_tag_);
+  }
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Update() {
   // We will perform update based on where the data is located.
@@ -115,14 +168,14 @@ void Blob<Dtype>::Update() {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
     caffe_axpy<Dtype>(count_, Dtype(-1),
-        reinterpret_cast<const Dtype*>(diff_->cpu_data()),
+        reinterpret_cast<const Dtype*>(diff()->cpu_data()),
         reinterpret_cast<Dtype*>(data_->mutable_cpu_data()));
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
     // perform computation on GPU
     caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        reinterpret_cast<const Dtype*>(diff_->gpu_data()),
+        reinterpret_cast<const Dtype*>(diff()->gpu_data()),
         reinterpret_cast<Dtype*>(data_->mutable_gpu_data()));
     break;
   default:
@@ -143,7 +196,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
-      CUDA_CHECK(cudaMemcpy(diff_->mutable_gpu_data(), source.gpu_diff(),
+      CUDA_CHECK(cudaMemcpy(diff()->mutable_gpu_data(), source.gpu_diff(),
           sizeof(Dtype) * count_, cudaMemcpyDeviceToDevice));
     } else {
       CUDA_CHECK(cudaMemcpy(data_->mutable_gpu_data(), source.gpu_data(),
@@ -152,7 +205,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
     break;
   case Caffe::CPU:
     if (copy_diff) {
-      memcpy(diff_->mutable_cpu_data(), source.cpu_diff(),
+      memcpy(diff()->mutable_cpu_data(), source.cpu_diff(),
           sizeof(Dtype) * count_);
     } else {
       memcpy(data_->mutable_cpu_data(), source.cpu_data(),
@@ -172,7 +225,7 @@ void Blob<Dtype>::FromProto(const BlobProto& proto) {
   for (int i = 0; i < count_; ++i) {
     data_vec[i] = proto.data(i);
   }
-  if (proto.diff_size() > 0) {
+  if (proto.diff_size() > 0 && diff_enabled_) {
     Dtype* diff_vec = mutable_cpu_diff();
     for (int i = 0; i < count_; ++i) {
       diff_vec[i] = proto.diff(i);
@@ -30,6 +30,7 @@ void ConvolutionLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   // overly large memory usage.
   int height_out = (height_ + 2 * pad_ - kernel_size_) / stride_ + 1;
   int width_out = (width_ + 2 * pad_ - kernel_size_) / stride_ + 1;
+  this->TrackMemory(&col_buffer_, MemoryTracker::WORKSPACE);
   col_buffer_.Reshape(
       1, channels_ * kernel_size_ * kernel_size_, height_out, width_out);
   // Set the parameters
@@ -68,6 +69,7 @@ void ConvolutionLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   // Set up the bias filler
   if (bias_term_) {
     bias_multiplier_.reset(new SyncedMemory(N_ * sizeof(Dtype)));
+    this->TrackMemory(bias_multiplier_.get(), MemoryTracker::WORKSPACE);
     Dtype* bias_multiplier_data =
         reinterpret_cast<Dtype*>(bias_multiplier_->mutable_cpu_data());
     for (int i = 0; i < N_; ++i) {
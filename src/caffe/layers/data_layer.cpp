@@ -1,13 +1,17 @@
 // Copyright 2014 BVLC and contributors.
 
 #include <stdint.h>
-#include <leveldb/db.h>
 //#include <pthread.h>
 
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/data_transform.hpp"
+#include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -19,106 +23,347 @@ namespace caffe {
 
 template <typename Dtype>
 void* DataLayerPrefetch(void* layer_pointer) {
+  TraceThread trace_thread;
   CHECK(layer_pointer);
   DataLayer<Dtype>* layer = static_cast<DataLayer<Dtype>*>(layer_pointer);
   CHECK(layer);
-  Datum datum;
-  CHECK(layer->prefetch_data_);
-  Dtype* top_data = layer->prefetch_data_->mutable_cpu_data();
-  Dtype* top_label;
-  if (layer->output_labels_) {
-    top_label = layer->prefetch_label_->mutable_cpu_data();
-  }
-  const Dtype scale = layer->layer_param_.data_param().scale();
-  const int batch_size = layer->layer_param_.data_param().batch_size();
-  const int crop_size = layer->layer_param_.data_param().crop_size();
-  const bool mirror = layer->layer_param_.data_param().mirror();
+  while (true) {
+    const int slot = layer->prefetch_free_.Pop();
+    if (slot < 0) {
+      // JoinPrefetchThread asked us to stop.
+      break;
+    }
+    {
+      TraceScope trace(layer->layer_param_.name().c_str(), "prefetch");
+      layer->PrefetchBatch(slot);
+    }
+    layer->prefetch_full_.Push(slot);
+  }
+  return static_cast<void*>(NULL);
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::PrefetchBatch(const int slot) {
+  CHECK(prefetch_data_[slot]);
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  const int crop_size = this->layer_param_.data_param().crop_size();
+  const bool mirror = this->layer_param_.data_param().mirror();
 
   if (mirror && crop_size == 0) {
     LOG(FATAL) << "Current implementation requires mirror and crop_size to be "
         << "set at the same time.";
   }
-  // datum scales
-  const int channels = layer->datum_channels_;
-  const int height = layer->datum_height_;
-  const int width = layer->datum_width_;
-  const int size = layer->datum_size_;
-  const Dtype* mean = layer->data_mean_.cpu_data();
+  // The cursor is not thread-safe, so the records are located here and only
+  // parsed and transformed by the workers. Records are parsed in place when
+  // the backend keeps them mapped, and copied out otherwise.
+  const bool values_stable = cursor_->values_stable();
+  const bool shuffle = this->layer_param_.data_param().shuffle();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    CHECK(layer->iter_);
-    CHECK(layer->iter_->Valid());
-    datum.ParseFromString(layer->iter_->value().ToString());
-    const string& data = datum.data();
-    if (crop_size) {
-      CHECK(data.size()) << "Image cropping only support uint8 data";
-      int h_off, w_off;
-      // We only do random crop when we do training.
-      if (layer->phase_ == Caffe::TRAIN) {
-        h_off = layer->PrefetchRand() % (height - crop_size);
-        w_off = layer->PrefetchRand() % (width - crop_size);
-      } else {
-        h_off = (height - crop_size) / 2;
-        w_off = (width - crop_size) / 2;
+    if (shuffle) {
+      if (readahead_pos_ == readahead_records_.size()) {
+        ReadAhead();
       }
-      if (mirror && layer->PrefetchRand() % 2) {
-        // Copy mirrored version
-        for (int c = 0; c < channels; ++c) {
-          for (int h = 0; h < crop_size; ++h) {
-            for (int w = 0; w < crop_size; ++w) {
-              int top_index = ((item_id * channels + c) * crop_size + h)
-                              * crop_size + (crop_size - 1 - w);
-              int data_index = (c * height + h + h_off) * width + w + w_off;
-              Dtype datum_element =
-                  static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-              top_data[top_index] = (datum_element - mean[data_index]) * scale;
-            }
-          }
-        }
-      } else {
-        // Normal copy
-        for (int c = 0; c < channels; ++c) {
-          for (int h = 0; h < crop_size; ++h) {
-            for (int w = 0; w < crop_size; ++w) {
-              int top_index = ((item_id * channels + c) * crop_size + h)
-                              * crop_size + w;
-              int data_index = (c * height + h + h_off) * width + w + w_off;
-              Dtype datum_element =
-                  static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-              top_data[top_index] = (datum_element - mean[data_index]) * scale;
-            }
-          }
-        }
-      }
-    } else {
-      // we will prefer to use data() first, and then try float_data()
-      if (data.size()) {
-        for (int j = 0; j < size; ++j) {
-          Dtype datum_element =
-              static_cast<Dtype>(static_cast<uint8_t>(data[j]));
-          top_data[item_id * size + j] = (datum_element - mean[j]) * scale;
-        }
+      if (values_stable) {
+        prefetch_records_[item_id] = readahead_records_[readahead_pos_];
       } else {
-        for (int j = 0; j < size; ++j) {
-          top_data[item_id * size + j] =
-              (datum.float_data(j) - mean[j]) * scale;
-        }
+        prefetch_values_[item_id].swap(readahead_values_[readahead_pos_]);
+        prefetch_records_[item_id] = std::make_pair(
+            prefetch_values_[item_id].data(), prefetch_values_[item_id].size());
       }
+      ++readahead_pos_;
+      continue;
     }
-
-    if (layer->output_labels_) {
-      top_label[item_id] = datum.label();
+    // get a blob
+    CHECK(cursor_);
+    CHECK(cursor_->valid());
+    if (values_stable) {
+      prefetch_records_[item_id] =
+          std::make_pair(cursor_->value_data(), cursor_->value_size());
+    } else {
+      prefetch_values_[item_id].assign(cursor_->value_data(),
+          cursor_->value_size());
+      prefetch_records_[item_id] = std::make_pair(
+          prefetch_values_[item_id].data(), prefetch_values_[item_id].size());
     }
     // go to the next iter
-    layer->iter_->Next();
-    if (!layer->iter_->Valid()) {
+    AdvanceCursor();
+  }
+  GetReadPosition(&prefetch_cursor_[slot]);
+  const Caffe::Phase phase = prefetch_phase_[slot];
+  Dtype* top_data = prefetch_data_[slot]->mutable_cpu_data();
+  Dtype* top_label = NULL;
+  if (output_labels_) {
+    top_label = prefetch_label_[slot]->mutable_cpu_data();
+  }
+  const unsigned int seed = prefetch_rng_ ? PrefetchRand() : 0;
+  workers_->Run(batch_size, seed,
+      [this, phase, top_data, top_label](int item_id, rng_t* rng) {
+    this->PrefetchItem(item_id, phase, rng, top_data, top_label);
+  });
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::AdvanceCursor() {
+  cursor_->Next();
+  if (keys_.empty()) {
+    if (!cursor_->valid()) {
       // We have reached the end. Restart from the first.
       DLOG(INFO) << "Restarting data prefetching from start.";
-      layer->iter_->SeekToFirst();
+      cursor_->SeekToFirst();
     }
+  } else if (++shard_pos_ == shard_size_) {
+    // We have reached the end of the shard. Restart from its first record.
+    DLOG(INFO) << "Restarting data prefetching from start of shard.";
+    SeekToShard();
   }
+}
 
-  return static_cast<void*>(NULL);
+template <typename Dtype>
+void DataLayer<Dtype>::SeekToShard() {
+  const string& key = keys_[shard_begin_];
+  CHECK(cursor_->Seek(key) && cursor_->key() == key) << "Key " << key
+      << " is not in " << this->layer_param_.data_param().source()
+      << "; the key index is out of date.";
+  shard_pos_ = 0;
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::ReadAhead() {
+  if (shuffle_pos_ == shard_size_) {
+    shuffle_pos_ = 0;
+  }
+  if (shuffle_pos_ == 0) {
+    DLOG(INFO) << "Shuffling the key index for a new epoch.";
+    shuffle_seed_ = PrefetchRand();
+    ShuffleKeys();
+  }
+  // The window never crosses an epoch, so that it can be looked up before the
+  // next epoch is shuffled.
+  const int window = std::min<int>(shard_size_ - shuffle_pos_,
+      std::max(this->layer_param_.data_param().shuffle_readahead(),
+               this->layer_param_.data_param().batch_size()));
+  // Sorting the lookups by key (keys_ is in key order) keeps the seeks moving
+  // forward through the DB, so neighbouring records share the blocks or pages
+  // read for them.
+  vector<std::pair<int, int> > lookups(window);
+  for (int i = 0; i < window; ++i) {
+    lookups[i] = std::make_pair(shuffle_order_[shuffle_pos_ + i], i);
+  }
+  std::sort(lookups.begin(), lookups.end());
+  const bool values_stable = cursor_->values_stable();
+  readahead_records_.resize(window);
+  if (!values_stable) {
+    readahead_values_.resize(window);
+  }
+  for (int i = 0; i < window; ++i) {
+    const string& key = keys_[lookups[i].first];
+    const int pos = lookups[i].second;
+    CHECK(cursor_->Seek(key) && cursor_->key() == key) << "Key " << key
+        << " is not in " << this->layer_param_.data_param().source()
+        << "; the key index is out of date.";
+    if (values_stable) {
+      readahead_records_[pos] =
+          std::make_pair(cursor_->value_data(), cursor_->value_size());
+    } else {
+      readahead_values_[pos].assign(cursor_->value_data(),
+          cursor_->value_size());
+      readahead_records_[pos] = std::make_pair(
+          readahead_values_[pos].data(), readahead_values_[pos].size());
+    }
+  }
+  shuffle_pos_ += window;
+  readahead_pos_ = 0;
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::ShuffleKeys() {
+  // Each epoch's permutation depends only on its seed, so that a saved
+  // cursor can recreate it.
+  rng_t rng(shuffle_seed_);
+  for (int i = 0; i < shard_size_; ++i) {
+    shuffle_order_[i] = shard_begin_ + i;
+  }
+  for (int i = shard_size_ - 1; i > 0; --i) {
+    std::swap(shuffle_order_[i], shuffle_order_[rng() % (i + 1)]);
+  }
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::GetReadPosition(DataCursor* cursor) {
+  cursor->Clear();
+  if (this->layer_param_.data_param().shuffle()) {
+    // Records looked up but not yet batched are still to be read.
+    if (shuffle_pos_ > 0) {
+      cursor->set_shuffle_seed(shuffle_seed_);
+    }
+    cursor->set_position(
+        shuffle_pos_ - (readahead_records_.size() - readahead_pos_));
+  } else {
+    cursor->set_key(cursor_->key());
+    if (!keys_.empty()) {
+      cursor->set_position(shard_pos_);
+    }
+  }
+}
+
+template <typename Dtype>
+bool DataLayer<Dtype>::GetDataCursor(DataCursor* cursor) {
+  cursor->CopyFrom(data_cursor_);
+  return true;
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::SeekDataCursor(const DataCursor& cursor) {
+  // Stop prefetching and drop the batches read from the old position.
+  JoinPrefetchThread();
+  int slot;
+  while (prefetch_full_.TryPop(&slot)) {}
+  if (this->layer_param_.data_param().shuffle()) {
+    CHECK_LE(cursor.position(), shard_size_);
+    readahead_records_.clear();
+    readahead_values_.clear();
+    readahead_pos_ = 0;
+    if (cursor.has_shuffle_seed()) {
+      shuffle_seed_ = cursor.shuffle_seed();
+      ShuffleKeys();
+      shuffle_pos_ = cursor.position();
+    } else {
+      // Nothing of the epoch was read; it gets a new permutation.
+      shuffle_pos_ = 0;
+    }
+  } else {
+    CHECK(cursor.has_key()) << "No key to seek "
+        << this->layer_param_.name() << " to.";
+    CHECK(cursor_->Seek(cursor.key()) && cursor_->key() == cursor.key())
+        << "Key " << cursor.key() << " is not in "
+        << this->layer_param_.data_param().source();
+    if (!keys_.empty()) {
+      CHECK_LT(cursor.position(), shard_size_);
+      shard_pos_ = cursor.position();
+    }
+  }
+  data_cursor_.CopyFrom(cursor);
+  for (slot = 0; slot < prefetch_data_.size(); ++slot) {
+    RecyclePrefetchSlot(slot);
+  }
+  CreatePrefetchThread();
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::BuildKeyIndex() {
+  const string& index_file = this->layer_param_.data_param().key_index_file();
+  keys_.clear();
+  std::ifstream infile(index_file.c_str());
+  if (!index_file.empty() && infile.good()) {
+    LOG(INFO) << "Loading key index from " << index_file;
+    string key;
+    while (std::getline(infile, key)) {
+      keys_.push_back(key);
+    }
+    // The index is written in key order, but sorting is cheap next to the
+    // lookups that rely on it.
+    std::sort(keys_.begin(), keys_.end());
+  } else {
+    LOG(INFO) << "Indexing the keys of "
+        << this->layer_param_.data_param().source();
+    for (cursor_->SeekToFirst(); cursor_->valid(); cursor_->Next()) {
+      keys_.push_back(cursor_->key());
+    }
+    if (!index_file.empty()) {
+      LOG(INFO) << "Writing key index to " << index_file;
+      std::ofstream outfile(index_file.c_str());
+      for (int i = 0; i < keys_.size(); ++i) {
+        CHECK_EQ(keys_[i].find('\n'), string::npos)
+            << "Keys with newlines cannot be written to a key index file.";
+        outfile << keys_[i] << '\n';
+      }
+      CHECK(outfile.good()) << "Failed to write " << index_file;
+    }
+    cursor_->SeekToFirst();
+  }
+  CHECK(!keys_.empty()) << "Empty database "
+      << this->layer_param_.data_param().source();
+  // Each shard reads a contiguous range of keys, so that its records stay
+  // sequential in the DB.
+  const int num_shards = this->layer_param_.data_param().num_shards();
+  const int shard_id = this->layer_param_.data_param().shard_id();
+  const int64_t num_keys = keys_.size();
+  CHECK_GE(num_keys, num_shards) << "Fewer records than shards.";
+  shard_begin_ = num_keys * shard_id / num_shards;
+  shard_size_ = num_keys * (shard_id + 1) / num_shards - shard_begin_;
+  if (num_shards > 1) {
+    LOG(INFO) << "Reading records " << shard_begin_ << " to "
+        << shard_begin_ + shard_size_ << " of " << num_keys << " as shard "
+        << shard_id << " of " << num_shards << ".";
+  }
+  shuffle_order_.resize(shard_size_);
+  shuffle_pos_ = 0;
+  readahead_records_.clear();
+  readahead_values_.clear();
+  readahead_pos_ = 0;
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::PrefetchItem(const int item_id,
+    const Caffe::Phase phase, rng_t* rng, Dtype* top_data, Dtype* top_label) {
+  Datum datum;
+  const Dtype scale = this->layer_param_.data_param().scale();
+  const int crop_size = this->layer_param_.data_param().crop_size();
+  const bool mirror = this->layer_param_.data_param().mirror();
+  // datum scales
+  const int channels = datum_channels_;
+  const int height = datum_height_;
+  const int width = datum_width_;
+  const int size = datum_size_;
+  const Dtype* mean = data_mean_.cpu_data();
+
+  datum.ParseFromArray(prefetch_records_[item_id].first,
+      prefetch_records_[item_id].second);
+  if (datum.encoded()) {
+    // Decoding is the costly part of reading encoded records, so it is done
+    // here on the workers.
+    CHECK(DecodeDatum(this->layer_param_.data_param().new_height(),
+        this->layer_param_.data_param().new_width(), &datum));
+    CHECK_EQ(datum.channels(), channels);
+    CHECK_EQ(datum.height(), height) << "Encoded records decode to different "
+        << "sizes; set new_height and new_width.";
+    CHECK_EQ(datum.width(), width) << "Encoded records decode to different "
+        << "sizes; set new_height and new_width.";
+  }
+  // we will prefer to use data() first, and then try float_data()
+  const string& data = datum.data();
+  const uint8_t* uint8_data = reinterpret_cast<const uint8_t*>(data.data());
+  const float* float_data = datum.float_data().data();
+  if (crop_size) {
+    int h_off, w_off;
+    // We only do random crop when we do training.
+    if (phase == Caffe::TRAIN) {
+      h_off = (*rng)() % (height - crop_size);
+      w_off = (*rng)() % (width - crop_size);
+    } else {
+      h_off = (height - crop_size) / 2;
+      w_off = (width - crop_size) / 2;
+    }
+    const bool do_mirror = mirror && (*rng)() % 2;
+    Dtype* item_data = top_data + item_id * channels * crop_size * crop_size;
+    if (data.size()) {
+      caffe_transform_crop(channels, height, width, h_off, w_off, crop_size,
+          crop_size, do_mirror, uint8_data, mean, scale, item_data);
+    } else {
+      caffe_transform_crop(channels, height, width, h_off, w_off, crop_size,
+          crop_size, do_mirror, float_data, mean, scale, item_data);
+    }
+  } else {
+    if (data.size()) {
+      caffe_transform(size, uint8_data, mean, scale, top_data + item_id * size);
+    } else {
+      caffe_transform(size, float_data, mean, scale, top_data + item_id * size);
+    }
+  }
+
+  if (top_label) {
+    top_label[item_id] = datum.label();
+  }
 }
 
 template <typename Dtype>
@@ -137,50 +382,57 @@ void DataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   } else {
     output_labels_ = true;
   }
-  // Initialize the leveldb
-  leveldb::DB* db_temp;
-  leveldb::Options options;
-  options.create_if_missing = false;
-  options.max_open_files = 100;
-  LOG(INFO) << "Opening leveldb " << this->layer_param_.data_param().source();
-  leveldb::Status status = leveldb::DB::Open(
-      options, this->layer_param_.data_param().source(), &db_temp);
-  CHECK(status.ok()) << "Failed to open leveldb "
-      << this->layer_param_.data_param().source() << std::endl
-      << status.ToString();
-  db_.reset(db_temp);
-  iter_.reset(db_->NewIterator(leveldb::ReadOptions()));
-  iter_->SeekToFirst();
-  // Check if we would need to randomly skip a few data points
-  if (this->layer_param_.data_param().rand_skip()) {
+  // Initialize the DB and cursor
+  db_.reset(db::GetDB(this->layer_param_.data_param().backend()));
+  db_->Open(this->layer_param_.data_param().source(), db::READ);
+  cursor_.reset(db_->NewCursor());
+  // Shuffled or sharded reads need the keys; sequential reads of the whole
+  // DB just walk the cursor.
+  const bool shuffle = this->layer_param_.data_param().shuffle();
+  CHECK_LT(this->layer_param_.data_param().shard_id(),
+      this->layer_param_.data_param().num_shards());
+  keys_.clear();
+  if (shuffle || this->layer_param_.data_param().num_shards() > 1) {
+    BuildKeyIndex();
+    if (!shuffle) {
+      SeekToShard();
+    }
+  }
+  if (shuffle) {
+    if (this->layer_param_.data_param().rand_skip()) {
+      LOG(INFO) << "Ignoring rand_skip, as the records are shuffled.";
+    }
+  } else if (this->layer_param_.data_param().rand_skip()) {
+    // Check if we would need to randomly skip a few data points
     unsigned int skip = caffe_rng_rand() %
                         this->layer_param_.data_param().rand_skip();
     LOG(INFO) << "Skipping first " << skip << " data points.";
     while (skip-- > 0) {
-      iter_->Next();
-      if (!iter_->Valid()) {
-        iter_->SeekToFirst();
-      }
+      AdvanceCursor();
     }
   }
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  datum.ParseFromString(iter_->value().ToString());
+  CHECK(cursor_->valid()) << "Empty database "
+      << this->layer_param_.data_param().source();
+  datum.ParseFromArray(cursor_->value_data(), cursor_->value_size());
+  const int new_height = this->layer_param_.data_param().new_height();
+  const int new_width = this->layer_param_.data_param().new_width();
+  CHECK((new_height == 0 && new_width == 0) ||
+      (new_height > 0 && new_width > 0)) << "Current implementation requires "
+      "new_height and new_width to be set at the same time.";
+  if (datum.encoded()) {
+    CHECK(DecodeDatum(new_height, new_width, &datum));
+  }
   // image
   int crop_size = this->layer_param_.data_param().crop_size();
   if (crop_size > 0) {
     (*top)[0]->Reshape(this->layer_param_.data_param().batch_size(),
                        datum.channels(), crop_size, crop_size);
-    prefetch_data_.reset(new Blob<Dtype>(
-        this->layer_param_.data_param().batch_size(), datum.channels(),
-        crop_size, crop_size));
   } else {
     (*top)[0]->Reshape(
         this->layer_param_.data_param().batch_size(), datum.channels(),
         datum.height(), datum.width());
-    prefetch_data_.reset(new Blob<Dtype>(
-        this->layer_param_.data_param().batch_size(), datum.channels(),
-        datum.height(), datum.width()));
   }
   LOG(INFO) << "output data size: " << (*top)[0]->num() << ","
       << (*top)[0]->channels() << "," << (*top)[0]->height() << ","
@@ -188,9 +440,29 @@ void DataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   if (output_labels_) {
     (*top)[1]->Reshape(this->layer_param_.data_param().batch_size(), 1, 1, 1);
-    prefetch_label_.reset(
-        new Blob<Dtype>(this->layer_param_.data_param().batch_size(), 1, 1, 1));
   }
+  // prefetch ring
+  const int prefetch_depth = this->layer_param_.data_param().prefetch_depth();
+  CHECK_GT(prefetch_depth, 0) << "prefetch_depth must be positive.";
+  prefetch_data_.resize(prefetch_depth);
+  prefetch_label_.resize(prefetch_depth);
+  prefetch_phase_.resize(prefetch_depth, Caffe::phase());
+  prefetch_cursor_.resize(prefetch_depth);
+  GetReadPosition(&data_cursor_);
+  for (int slot = 0; slot < prefetch_depth; ++slot) {
+    prefetch_data_[slot].reset(new Blob<Dtype>());
+    prefetch_data_[slot]->ReshapeLike(*(*top)[0]);
+    if (output_labels_) {
+      prefetch_label_[slot].reset(new Blob<Dtype>());
+      prefetch_label_[slot]->ReshapeLike(*(*top)[1]);
+    }
+  }
+  LOG(INFO) << "Prefetching " << prefetch_depth << " batches ahead.";
+  prefetch_values_.resize(this->layer_param_.data_param().batch_size());
+  prefetch_records_.resize(this->layer_param_.data_param().batch_size());
+  workers_.reset(new WorkerPool(this->layer_param_.data_param().num_workers()));
+  LOG(INFO) << "Decoding batches with " << workers_->num_workers()
+      << " workers.";
   // datum size
   datum_channels_ = datum.channels();
   datum_height_ = datum.height();
@@ -213,15 +485,21 @@ void DataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
     // Simply initialize an all-empty mean.
     data_mean_.Reshape(1, datum_channels_, datum_height_, datum_width_);
   }
-  // Now, start the prefetch thread. Before calling prefetch, we make two
-  // cpu_data calls so that the prefetch thread does not accidentally make
-  // simultaneous cudaMalloc calls when the main thread is running. In some
-  // GPUs this seems to cause failures if we do not so.
-  prefetch_data_->mutable_cpu_data();
-  if (output_labels_) {
-    prefetch_label_->mutable_cpu_data();
+  this->TrackMemory(&data_mean_, MemoryTracker::WORKSPACE);
+  for (int slot = 0; slot < prefetch_depth; ++slot) {
+    this->TrackMemory(prefetch_data_[slot].get(), MemoryTracker::PREFETCH);
+    if (output_labels_) {
+      this->TrackMemory(prefetch_label_[slot].get(), MemoryTracker::PREFETCH);
+    }
   }
+  // Now, queue every slot and start the prefetch thread. RecyclePrefetchSlot
+  // makes the cpu_data calls so that the prefetch thread does not
+  // accidentally make simultaneous cudaMalloc calls when the main thread is
+  // running. In some GPUs this seems to cause failures if we do not so.
   data_mean_.cpu_data();
+  for (int slot = 0; slot < prefetch_depth; ++slot) {
+    RecyclePrefetchSlot(slot);
+  }
   DLOG(INFO) << "Initializing prefetch";
   CreatePrefetchThread();
   DLOG(INFO) << "Prefetch initialized.";
@@ -229,10 +507,12 @@ void DataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void DataLayer<Dtype>::CreatePrefetchThread() {
-  phase_ = Caffe::phase();
-  const bool prefetch_needs_rand = (phase_ == Caffe::TRAIN) &&
-      (this->layer_param_.data_param().mirror() ||
-       this->layer_param_.data_param().crop_size());
+  // The thread lives as long as the layer, so the rng is created whenever
+  // random crops or mirrors could be requested by any phase.
+  const bool prefetch_needs_rand =
+      this->layer_param_.data_param().shuffle() ||
+      this->layer_param_.data_param().mirror() ||
+      this->layer_param_.data_param().crop_size();
   if (prefetch_needs_rand) {
     const unsigned int prefetch_rng_seed = caffe_rng_rand();
     prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
@@ -240,15 +520,30 @@ void DataLayer<Dtype>::CreatePrefetchThread() {
     prefetch_rng_.reset();
   }
   // Create the thread.
-  //CHECK(!pthread_create(&thread_, NULL, DataLayerPrefetch<Dtype>,
-  //      static_cast<void*>(this))) << "Pthread execution failed.";
-  thread_ = thread(DataLayerPrefetch<Dtype>,reinterpret_cast<void*>(this));
+  thread_ = std::thread(DataLayerPrefetch<Dtype>,
+                        reinterpret_cast<void*>(this));
 }
 
 template <typename Dtype>
 void DataLayer<Dtype>::JoinPrefetchThread() {
-  //CHECK(!pthread_join(thread_, NULL)) << "Pthread joining failed.";
-  thread_.join();
+  if (thread_.joinable()) {
+    // A negative slot tells the prefetch thread to exit once it has drained
+    // the slots queued before it.
+    prefetch_free_.Push(-1);
+    thread_.join();
+  }
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::RecyclePrefetchSlot(const int slot) {
+  prefetch_data_[slot]->mutable_cpu_data();
+  if (output_labels_) {
+    prefetch_label_[slot]->mutable_cpu_data();
+  }
+  // Batches are filled for the phase current when they are queued, so a
+  // phase change reaches the top blobs after at most prefetch_depth batches.
+  prefetch_phase_[slot] = Caffe::phase();
+  prefetch_free_.Push(slot);
 }
 
 template <typename Dtype>
@@ -262,17 +557,17 @@ unsigned int DataLayer<Dtype>::PrefetchRand() {
 template <typename Dtype>
 Dtype DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
-  // First, join the thread
-  JoinPrefetchThread();
-  // Copy the data
-  caffe_copy(prefetch_data_->count(), prefetch_data_->cpu_data(),
-             (*top)[0]->mutable_cpu_data());
+  // Take the oldest ready batch; this only blocks if the prefetch thread has
+  // fallen behind by the whole ring.
+  const int slot = prefetch_full_.Pop();
+  // Hand the filled buffers to the top blobs, and give the buffers they held
+  // back to the slot to be refilled.
+  (*top)[0]->SwapData(prefetch_data_[slot].get());
   if (output_labels_) {
-    caffe_copy(prefetch_label_->count(), prefetch_label_->cpu_data(),
-               (*top)[1]->mutable_cpu_data());
+    (*top)[1]->SwapData(prefetch_label_[slot].get());
   }
-  // Start a new prefetch thread
-  CreatePrefetchThread();
+  data_cursor_.Swap(&prefetch_cursor_[slot]);
+  RecyclePrefetchSlot(slot);
   return Dtype(0.);
 }
 
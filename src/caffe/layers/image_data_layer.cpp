@@ -9,8 +9,10 @@
 #include <iostream>  // NOLINT(readability/streams)
 #include <fstream>  // NOLINT(readability/streams)
 #include <utility>
+#include <algorithm>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/data_transform.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -24,114 +26,124 @@ namespace caffe {
 
 template <typename Dtype>
 void* ImageDataLayerPrefetch(void* layer_pointer) {
+  TraceThread trace_thread;
   CHECK(layer_pointer);
   ImageDataLayer<Dtype>* layer =
       reinterpret_cast<ImageDataLayer<Dtype>*>(layer_pointer);
   CHECK(layer);
-  Datum datum;
   CHECK(layer->prefetch_data_);
+  TraceScope trace(layer->layer_param_.name().c_str(), "prefetch");
   Dtype* top_data = layer->prefetch_data_->mutable_cpu_data();
   Dtype* top_label = layer->prefetch_label_->mutable_cpu_data();
   ImageDataParameter image_data_param = layer->layer_param_.image_data_param();
-  const Dtype scale = image_data_param.scale();
   const int batch_size = image_data_param.batch_size();
   const int crop_size = image_data_param.crop_size();
   const bool mirror = image_data_param.mirror();
-  const int new_height = image_data_param.new_height();
-  const int new_width = image_data_param.new_width();
 
   if (mirror && crop_size == 0) {
     LOG(FATAL) << "Current implementation requires mirror and crop_size to be "
         << "set at the same time.";
   }
-  // datum scales
-  const int channels = layer->datum_channels_;
-  const int height = layer->datum_height_;
-  const int width = layer->datum_width_;
-  const int size = layer->datum_size_;
+  // Pick the images of the batch here, since walking and shuffling lines_ is
+  // sequential; loading and transforming them is split across the workers.
   const int lines_size = layer->lines_.size();
-  const Dtype* mean = layer->data_mean_.cpu_data();
+  bool epoch_done = false;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
     CHECK_GT(lines_size, layer->lines_id_);
-    if (!ReadImageToDatum(layer->lines_[layer->lines_id_].first,
-          layer->lines_[layer->lines_id_].second,
-          new_height, new_width, &datum)) {
-      continue;
-    }
-    const string& data = datum.data();
-    if (crop_size) {
-      CHECK(data.size()) << "Image cropping only support uint8 data";
-      int h_off, w_off;
-      // We only do random crop when we do training.
-      if (layer->phase_ == Caffe::TRAIN) {
-        h_off = layer->PrefetchRand() % (height - crop_size);
-        w_off = layer->PrefetchRand() % (width - crop_size);
-      } else {
-        h_off = (height - crop_size) / 2;
-        w_off = (width - crop_size) / 2;
-      }
-      if (mirror && layer->PrefetchRand() % 2) {
-        // Copy mirrored version
-        for (int c = 0; c < channels; ++c) {
-          for (int h = 0; h < crop_size; ++h) {
-            for (int w = 0; w < crop_size; ++w) {
-              int top_index = ((item_id * channels + c) * crop_size + h)
-                              * crop_size + (crop_size - 1 - w);
-              int data_index = (c * height + h + h_off) * width + w + w_off;
-              Dtype datum_element =
-                  static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-              top_data[top_index] = (datum_element - mean[data_index]) * scale;
-            }
-          }
-        }
-      } else {
-        // Normal copy
-        for (int c = 0; c < channels; ++c) {
-          for (int h = 0; h < crop_size; ++h) {
-            for (int w = 0; w < crop_size; ++w) {
-              int top_index = ((item_id * channels + c) * crop_size + h)
-                              * crop_size + w;
-              int data_index = (c * height + h + h_off) * width + w + w_off;
-              Dtype datum_element =
-                  static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-              top_data[top_index] = (datum_element - mean[data_index]) * scale;
-            }
-          }
-        }
-      }
-    } else {
-      // Just copy the whole data
-      if (data.size()) {
-        for (int j = 0; j < size; ++j) {
-          Dtype datum_element =
-              static_cast<Dtype>(static_cast<uint8_t>(data[j]));
-          top_data[item_id * size + j] = (datum_element - mean[j]) * scale;
-        }
-      } else {
-        for (int j = 0; j < size; ++j) {
-          top_data[item_id * size + j] =
-              (datum.float_data(j) - mean[j]) * scale;
-        }
-      }
-    }
-
-    top_label[item_id] = datum.label();
+    layer->prefetch_lines_[item_id] = layer->line_order_[layer->lines_id_];
     // go to the next iter
     layer->lines_id_++;
     if (layer->lines_id_ >= lines_size) {
       // We have reached the end. Restart from the first.
       DLOG(INFO) << "Restarting data prefetching from start.";
       layer->lines_id_ = 0;
+      epoch_done = true;
       if (layer->layer_param_.image_data_param().shuffle()) {
         layer->ShuffleImages();
       }
     }
   }
+  const unsigned int seed = layer->prefetch_rng_ ? layer->PrefetchRand() : 0;
+  layer->workers_->Run(batch_size, seed,
+      [layer, top_data, top_label](int item_id, rng_t* rng) {
+    layer->PrefetchItem(item_id, rng, top_data, top_label);
+  });
+  if (epoch_done && layer->cache_) {
+    const ImageCache& cache = *layer->cache_;
+    LOG(INFO) << "Image cache: " << cache.hits() << " hits, "
+        << cache.misses() << " misses, " << cache.evictions()
+        << " evictions, " << cache.size() << " images in "
+        << cache.bytes() / 1048576. << "MB";
+  }
 
   return reinterpret_cast<void*>(NULL);
 }
 
+template <typename Dtype>
+shared_ptr<const Datum> ImageDataLayer<Dtype>::ReadImage(const int line_id) {
+  if (cache_) {
+    shared_ptr<const Datum> cached = cache_->Get(line_id);
+    if (cached) {
+      return cached;
+    }
+  }
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  shared_ptr<Datum> datum(new Datum());
+  if (!ReadImageToDatum(lines_[line_id].first, lines_[line_id].second,
+        image_data_param.new_height(), image_data_param.new_width(),
+        datum.get())) {
+    return shared_ptr<const Datum>();
+  }
+  if (cache_) {
+    cache_->Put(line_id, datum);
+  }
+  return datum;
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::PrefetchItem(const int item_id, rng_t* rng,
+    Dtype* top_data, Dtype* top_label) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const Dtype scale = image_data_param.scale();
+  const int crop_size = image_data_param.crop_size();
+  const bool mirror = image_data_param.mirror();
+  // datum scales
+  const int channels = datum_channels_;
+  const int height = datum_height_;
+  const int width = datum_width_;
+  const int size = datum_size_;
+  const Dtype* mean = data_mean_.cpu_data();
+  shared_ptr<const Datum> datum = ReadImage(prefetch_lines_[item_id]);
+  if (!datum) {
+    return;
+  }
+  const string& data = datum->data();
+  CHECK(data.size()) << "ReadImageToDatum only produces uint8 data";
+  const uint8_t* uint8_data = reinterpret_cast<const uint8_t*>(data.data());
+  if (crop_size) {
+    int h_off, w_off;
+    // We only do random crop when we do training.
+    if (phase_ == Caffe::TRAIN) {
+      h_off = (*rng)() % (height - crop_size);
+      w_off = (*rng)() % (width - crop_size);
+    } else {
+      h_off = (height - crop_size) / 2;
+      w_off = (width - crop_size) / 2;
+    }
+    const bool do_mirror = mirror && (*rng)() % 2;
+    caffe_transform_crop(channels, height, width, h_off, w_off, crop_size,
+        crop_size, do_mirror, uint8_data, mean, scale,
+        top_data + item_id * channels * crop_size * crop_size);
+  } else {
+    // Just copy the whole data
+    caffe_transform(size, uint8_data, mean, scale, top_data + item_id * size);
+  }
+
+  top_label[item_id] = datum->label();
+}
+
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   JoinPrefetchThread();
@@ -153,8 +165,24 @@ void ImageDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   std::ifstream infile(source.c_str());
   string filename;
   int label;
-  while (infile >> filename >> label) {
-    lines_.push_back(std::make_pair(filename, label));
+  // Only this shard's lines are kept, so the images of other shards are
+  // never opened.
+  const int shard_id = this->layer_param_.image_data_param().shard_id();
+  const int num_shards = this->layer_param_.image_data_param().num_shards();
+  CHECK_LT(shard_id, num_shards);
+  for (int line_id = 0; infile >> filename >> label; ++line_id) {
+    if (line_id % num_shards == shard_id) {
+      lines_.push_back(std::make_pair(filename, label));
+    }
+  }
+  CHECK(!lines_.empty()) << "No images in " << source << " for shard "
+      << shard_id << " of " << num_shards;
+  if (num_shards > 1) {
+    LOG(INFO) << "Reading shard " << shard_id << " of " << num_shards;
+  }
+  line_order_.resize(lines_.size());
+  for (int i = 0; i < line_order_.size(); ++i) {
+    line_order_[i] = i;
   }
 
   if (this->layer_param_.image_data_param().shuffle()) {
@@ -175,10 +203,17 @@ void ImageDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  const int cache_size_mb =
+      this->layer_param_.image_data_param().cache_size_mb();
+  if (cache_size_mb > 0) {
+    cache_.reset(new ImageCache(static_cast<size_t>(cache_size_mb) << 20));
+    LOG(INFO) << "Caching up to " << cache_size_mb << "MB of images.";
+  }
   // Read a data point, and use it to initialize the top blob.
-  Datum datum;
-  CHECK(ReadImageToDatum(lines_[lines_id_].first, lines_[lines_id_].second,
-                         new_height, new_width, &datum));
+  const int first_line_id = line_order_[lines_id_];
+  shared_ptr<const Datum> first_datum = ReadImage(first_line_id);
+  CHECK(first_datum) << "Could not read " << lines_[first_line_id].first;
+  const Datum& datum = *first_datum;
   // image
   const int crop_size = this->layer_param_.image_data_param().crop_size();
   const int batch_size = this->layer_param_.image_data_param().batch_size();
@@ -199,6 +234,11 @@ void ImageDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   (*top)[1]->Reshape(batch_size, 1, 1, 1);
   prefetch_label_.reset(new Blob<Dtype>(batch_size, 1, 1, 1));
+  prefetch_lines_.resize(batch_size);
+  workers_.reset(new WorkerPool(
+      this->layer_param_.image_data_param().num_workers()));
+  LOG(INFO) << "Loading batches with " << workers_->num_workers()
+      << " workers.";
   // datum size
   datum_channels_ = datum.channels();
   datum_height_ = datum.height();
@@ -220,6 +260,9 @@ void ImageDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
     // Simply initialize an all-empty mean.
     data_mean_.Reshape(1, datum_channels_, datum_height_, datum_width_);
   }
+  this->TrackMemory(&data_mean_, MemoryTracker::WORKSPACE);
+  this->TrackMemory(prefetch_data_.get(), MemoryTracker::PREFETCH);
+  this->TrackMemory(prefetch_label_.get(), MemoryTracker::PREFETCH);
   // Now, start the prefetch thread. Before calling prefetch, we make two
   // cpu_data calls so that the prefetch thread does not accidentally make
   // simultaneous cudaMalloc calls when the main thread is running. In some
@@ -246,22 +289,59 @@ void ImageDataLayer<Dtype>::CreatePrefetchThread() {
   } else {
     prefetch_rng_.reset();
   }
+  // The batch about to be prefetched is the next one Forward returns, so it
+  // starts where a resumed layer should read from.
+  data_cursor_.Clear();
+  data_cursor_.set_position(lines_id_);
+  if (this->layer_param_.image_data_param().shuffle()) {
+    data_cursor_.set_shuffle_seed(shuffle_seed_);
+  }
   // Create the thread.
   //CHECK(!pthread_create(&thread_, NULL, ImageDataLayerPrefetch<Dtype>,
   //      static_cast<void*>(this))) << "Pthread execution failed.";
-  thread_ = thread(ImageDataLayerPrefetch<Dtype>,reinterpret_cast<void*>(this));
+  thread_ = std::thread(ImageDataLayerPrefetch<Dtype>,reinterpret_cast<void*>(this));
 }
 
 template <typename Dtype>
 void ImageDataLayer<Dtype>::ShuffleImages() {
+  shuffle_seed_ = PrefetchRand();
+  PermuteLines();
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::PermuteLines() {
+  // Each epoch's order depends only on its seed, so that a saved cursor can
+  // recreate it.
+  rng_t rng(shuffle_seed_);
   const int num_images = lines_.size();
   for (int i = 0; i < num_images; ++i) {
-    const int max_rand_index = num_images - i;
-    const int rand_index = PrefetchRand() % max_rand_index;
-    pair<string, int> item = lines_[rand_index];
-    lines_.erase(lines_.begin() + rand_index);
-    lines_.push_back(item);
+    line_order_[i] = i;
+  }
+  for (int i = num_images - 1; i > 0; --i) {
+    std::swap(line_order_[i], line_order_[rng() % (i + 1)]);
+  }
+}
+
+template <typename Dtype>
+bool ImageDataLayer<Dtype>::GetDataCursor(DataCursor* cursor) {
+  cursor->CopyFrom(data_cursor_);
+  return true;
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::SeekDataCursor(const DataCursor& cursor) {
+  // Drop the batch prefetched from the old position.
+  JoinPrefetchThread();
+  CHECK_GE(cursor.position(), 0);
+  CHECK_LT(cursor.position(), lines_.size());
+  if (this->layer_param_.image_data_param().shuffle()) {
+    CHECK(cursor.has_shuffle_seed()) << "No shuffle seed to seek "
+        << this->layer_param_.name() << " to.";
+    shuffle_seed_ = cursor.shuffle_seed();
+    PermuteLines();
   }
+  lines_id_ = cursor.position();
+  CreatePrefetchThread();
 }
 
 template <typename Dtype>
@@ -325,28 +325,30 @@ void HingeLossLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
   CHECK_EQ(bottom.size(), 2) << "Hinge Loss Layer takes two blobs as input.";
   CHECK_EQ(top->size(), 0) << "Hinge Loss Layer takes no output.";
+  margins_.Reshape(bottom[0]->num(), bottom[0]->channels(),
+      bottom[0]->height(), bottom[0]->width());
 }
 
 template <typename Dtype>
 Dtype HingeLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  Dtype* margins = margins_.mutable_cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
   int num = bottom[0]->num();
   int count = bottom[0]->count();
   int dim = count / num;
 
-  caffe_copy(count, bottom_data, bottom_diff);
+  caffe_copy(count, bottom_data, margins);
   for (int i = 0; i < num; ++i) {
-    bottom_diff[i * dim + static_cast<int>(label[i])] *= -1;
+    margins[i * dim + static_cast<int>(label[i])] *= -1;
   }
   for (int i = 0; i < num; ++i) {
     for (int j = 0; j < dim; ++j) {
-      bottom_diff[i * dim + j] = max(Dtype(0), 1 + bottom_diff[i * dim + j]);
+      margins[i * dim + j] = max(Dtype(0), 1 + margins[i * dim + j]);
     }
   }
-  return caffe_cpu_asum(count, bottom_diff) / num;
+  return caffe_cpu_asum(count, margins) / num;
 }
 
 template <typename Dtype>
@@ -358,7 +360,7 @@ void HingeLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   int count = (*bottom)[0]->count();
   int dim = count / num;
 
-  caffe_cpu_sign(count, bottom_diff, bottom_diff);
+  caffe_cpu_sign(count, margins_.cpu_data(), bottom_diff);
   for (int i = 0; i < num; ++i) {
     bottom_diff[i * dim + static_cast<int>(label[i])] *= -1;
   }
@@ -26,10 +26,16 @@ void LRNLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   switch (this->layer_param_.lrn_param().norm_region()) {
   case LRNParameter_NormRegion_ACROSS_CHANNELS:
     (*top)[0]->Reshape(num_, channels_, height_, width_);
+    this->TrackMemory(&scale_, MemoryTracker::WORKSPACE);
     scale_.Reshape(num_, channels_, height_, width_);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
     {
+      // The intermediate results are the buffers of this layer.
+      this->TrackMemory(&square_input_, MemoryTracker::WORKSPACE);
+      this->TrackMemory(&square_output_, MemoryTracker::WORKSPACE);
+      this->TrackMemory(&pool_output_, MemoryTracker::WORKSPACE);
+      this->TrackMemory(&power_output_, MemoryTracker::WORKSPACE);
       // Set up split_layer_ to use inputs in the numerator and denominator.
       split_top_vec_.clear();
       split_top_vec_.push_back(bottom[0]);
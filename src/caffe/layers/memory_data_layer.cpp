@@ -1,8 +1,12 @@
 // Copyright 2014 BVLC and contributors.
 
+#include <algorithm>
+#include <chrono>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -23,6 +27,19 @@ void MemoryDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   (*top)[1]->Reshape(batch_size_, 1, 1, 1);
   data_ = NULL;
   labels_ = NULL;
+  queue_capacity_ = this->layer_param_.memory_data_param().queue_size();
+  if (queue_capacity_ == 0) {
+    queue_capacity_ = 2 * batch_size_;
+  }
+  CHECK_GE(queue_capacity_, batch_size_)
+      << "queue_size must hold at least one batch";
+  queue_data_.clear();
+  queue_labels_.clear();
+  queue_push_times_.clear();
+  queue_head_ = 0;
+  queue_count_ = 0;
+  timeout_ms_ = this->layer_param_.memory_data_param().timeout_ms();
+  last_batch_size_ = 0;
 }
 
 template <typename Dtype>
@@ -30,19 +47,82 @@ void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
+  CHECK(queue_data_.empty()) << "Reset cannot be used after Push";
   data_ = data;
   labels_ = labels;
   n_ = n;
   pos_ = 0;
 }
 
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::Push(const Dtype* data, Dtype label) {
+  CHECK(!data_) << "Push cannot be used after Reset";
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    if (queue_data_.empty()) {
+      queue_data_.resize(queue_capacity_ * datum_size_);
+      queue_labels_.resize(queue_capacity_);
+      queue_push_times_.resize(queue_capacity_);
+    }
+    while (queue_count_ == queue_capacity_) {
+      queue_not_full_.wait(lock);
+    }
+    const int slot = (queue_head_ + queue_count_) % queue_capacity_;
+    caffe_copy(datum_size_, data, &queue_data_[slot * datum_size_]);
+    queue_labels_[slot] = label;
+    queue_push_times_[slot] = MonotonicMicros();
+    ++queue_count_;
+  }
+  queue_not_empty_.notify_one();
+}
+
 template <typename Dtype>
 Dtype MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
-  CHECK(data_) << "MemoryDataLayer needs to be initalized by calling Reset";
-  (*top)[0]->set_cpu_data(data_ + pos_ * datum_size_);
-  (*top)[1]->set_cpu_data(labels_ + pos_);
-  pos_ = (pos_ + batch_size_) % n_;
+  if (data_) {
+    (*top)[0]->set_cpu_data(data_ + pos_ * datum_size_);
+    (*top)[1]->set_cpu_data(labels_ + pos_);
+    pos_ = (pos_ + batch_size_) % n_;
+    return Dtype(0.);
+  }
+  // No array was given to Reset: take the batch from the Push queue.
+  Dtype* top_data = (*top)[0]->mutable_cpu_data();
+  Dtype* top_label = (*top)[1]->mutable_cpu_data();
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (queue_count_ < batch_size_) {
+      if (timeout_ms_ == 0 || queue_count_ == 0) {
+        queue_not_empty_.wait(lock);
+        continue;
+      }
+      // The timeout runs from the push of the oldest queued sample, which
+      // only Forward removes. It is measured on MonotonicMicros, as
+      // steady_clock follows the wall clock before VS2015, and re-checked
+      // after every wake-up.
+      const int64_t remaining_us = static_cast<int64_t>(timeout_ms_) * 1000 -
+          (MonotonicMicros() - queue_push_times_[queue_head_]);
+      if (remaining_us <= 0) {
+        break;
+      }
+      queue_not_empty_.wait_for(lock, std::chrono::microseconds(remaining_us));
+    }
+    last_batch_size_ = std::min(queue_count_, batch_size_);
+    for (int i = 0; i < last_batch_size_; ++i) {
+      const int slot = (queue_head_ + i) % queue_capacity_;
+      caffe_copy(datum_size_, &queue_data_[slot * datum_size_],
+          top_data + i * datum_size_);
+      top_label[i] = queue_labels_[slot];
+    }
+    queue_head_ = (queue_head_ + last_batch_size_) % queue_capacity_;
+    queue_count_ -= last_batch_size_;
+  }
+  queue_not_full_.notify_all();
+  const int missing = batch_size_ - last_batch_size_;
+  if (missing > 0) {
+    caffe_set(missing * datum_size_, Dtype(0),
+        top_data + last_batch_size_ * datum_size_);
+    caffe_set(missing, Dtype(0), top_label + last_batch_size_);
+  }
   return Dtype(0.);
 }
 
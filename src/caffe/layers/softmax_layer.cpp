@@ -18,6 +18,8 @@ void SoftmaxLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(top->size(), 1) << "Softmax Layer takes a single blob as output.";
   (*top)[0]->Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
+  this->TrackMemory(&sum_multiplier_, MemoryTracker::WORKSPACE);
+  this->TrackMemory(&scale_, MemoryTracker::WORKSPACE);
   sum_multiplier_.Reshape(1, bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
   Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
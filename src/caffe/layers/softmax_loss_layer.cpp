@@ -20,6 +20,9 @@ void SoftmaxWithLossLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   softmax_bottom_vec_.clear();
   softmax_bottom_vec_.push_back(bottom[0]);
   softmax_top_vec_.push_back(&prob_);
+  this->TrackMemory(&prob_, MemoryTracker::WORKSPACE);
+  softmax_layer_->set_memory_tracker(this->memory_tracker_,
+      this->memory_owner_);
   softmax_layer_->SetUp(softmax_bottom_vec_, &softmax_top_vec_);
 }
 
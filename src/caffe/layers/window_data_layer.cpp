@@ -18,6 +18,7 @@
 #include "opencv2/imgproc/imgproc.hpp"
 
 #include "caffe/layer.hpp"
+#include "caffe/util/data_transform.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -39,220 +40,302 @@ namespace caffe {
 
 template <typename Dtype>
 void* WindowDataLayerPrefetch(void* layer_pointer) {
+  TraceThread trace_thread;
   WindowDataLayer<Dtype>* layer =
       reinterpret_cast<WindowDataLayer<Dtype>*>(layer_pointer);
+  TraceScope trace(layer->layer_param_.name().c_str(), "prefetch");
 
   // At each iteration, sample N windows where N*p are foreground (object)
   // windows and N*(1-p) are background (non-object) windows
 
   Dtype* top_data = layer->prefetch_data_->mutable_cpu_data();
   Dtype* top_label = layer->prefetch_label_->mutable_cpu_data();
-  const Dtype scale = layer->layer_param_.window_data_param().scale();
   const int batch_size = layer->layer_param_.window_data_param().batch_size();
-  const int crop_size = layer->layer_param_.window_data_param().crop_size();
-  const int context_pad = layer->layer_param_.window_data_param().context_pad();
-  const bool mirror = layer->layer_param_.window_data_param().mirror();
-  const float fg_fraction =
-      layer->layer_param_.window_data_param().fg_fraction();
-  const Dtype* mean = layer->data_mean_.cpu_data();
-  const int mean_off = (layer->data_mean_.width() - crop_size) / 2;
-  const int mean_width = layer->data_mean_.width();
-  const int mean_height = layer->data_mean_.height();
-  cv::Size cv_crop_size(crop_size, crop_size);
-  const string& crop_mode = layer->layer_param_.window_data_param().crop_mode();
-
-  bool use_square = (crop_mode == "square") ? true : false;
 
   // zero out batch
   memset(top_data, 0, sizeof(Dtype)*layer->prefetch_data_->count());
 
+  const int image_field = WindowDataLayer<Dtype>::IMAGE_INDEX;
+  const unsigned int seed = layer->PrefetchRand();
+  if (!layer->layer_param_.window_data_param().group_by_image()) {
+    // Every window is sampled, loaded and warped by one of the workers.
+    layer->workers_->Run(batch_size, seed,
+        [layer, top_data, top_label, image_field](int item_id, rng_t* rng) {
+      layer->SampleWindow(item_id, rng);
+      cv::Mat cv_img;
+      shared_ptr<const Datum> cached;
+      const int image_index = (*layer->batch_windows_[item_id])[image_field];
+      if (layer->LoadImage(image_index, &cv_img, &cached)) {
+        layer->WarpWindow(item_id, cv_img, top_data, top_label);
+      }
+    });
+    return reinterpret_cast<void*>(NULL);
+  }
+  // Sample the whole batch here, seeding each item as the workers would, so
+  // that grouping does not change which windows are drawn.
+  rng_t rng;
+  std::map<int, int> group_of_image;
+  layer->batch_groups_.clear();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    rng.seed(static_cast<rng_t::result_type>(seed + item_id));
+    layer->SampleWindow(item_id, &rng);
+    const int image_index = (*layer->batch_windows_[item_id])[image_field];
+    std::map<int, int>::iterator it = group_of_image.find(image_index);
+    if (it == group_of_image.end()) {
+      it = group_of_image.insert(
+          std::make_pair(image_index, layer->batch_groups_.size())).first;
+      layer->batch_groups_.push_back(vector<int>());
+    }
+    layer->batch_groups_[it->second].push_back(item_id);
+  }
+  // Each worker loads the images of its groups once, and warps all of their
+  // windows.
+  layer->workers_->Run(layer->batch_groups_.size(), seed,
+      [layer, top_data, top_label, image_field](int group_id, rng_t*) {
+    const vector<int>& items = layer->batch_groups_[group_id];
+    const int image_index = (*layer->batch_windows_[items[0]])[image_field];
+    cv::Mat cv_img;
+    shared_ptr<const Datum> cached;
+    if (!layer->LoadImage(image_index, &cv_img, &cached)) {
+      return;
+    }
+    for (int i = 0; i < items.size(); ++i) {
+      layer->WarpWindow(items[i], cv_img, top_data, top_label);
+    }
+  });
+
+  return reinterpret_cast<void*>(NULL);
+}
+
+template <typename Dtype>
+void WindowDataLayer<Dtype>::SampleWindow(const int item_id, rng_t* rng) {
+  const int batch_size = this->layer_param_.window_data_param().batch_size();
+  const bool mirror = this->layer_param_.window_data_param().mirror();
+  const float fg_fraction =
+      this->layer_param_.window_data_param().fg_fraction();
+
+  // The batch holds the bg samples first and then the fg samples.
   const int num_fg = static_cast<int>(static_cast<float>(batch_size)
       * fg_fraction);
-  const int num_samples[2] = { batch_size - num_fg, num_fg };
-
-  int item_id = 0;
-  // sample from bg set then fg set
-  for (int is_fg = 0; is_fg < 2; ++is_fg) {
-    for (int dummy = 0; dummy < num_samples[is_fg]; ++dummy) {
-      // sample a window
-      const unsigned int rand_index = layer->PrefetchRand();
-      vector<float> window = (is_fg) ?
-          layer->fg_windows_[rand_index % layer->fg_windows_.size()] :
-          layer->bg_windows_[rand_index % layer->bg_windows_.size()];
-
-      bool do_mirror = false;
-      if (mirror && layer->PrefetchRand() % 2) {
-        do_mirror = true;
-      }
+  const int is_fg = (item_id >= batch_size - num_fg) ? 1 : 0;
 
-      // load the image containing the window
-      pair<std::string, vector<int> > image =
-          layer->image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
+  // sample a window
+  const unsigned int rand_index = (*rng)();
+  batch_windows_[item_id] = (is_fg) ?
+      &fg_windows_[rand_index % fg_windows_.size()] :
+      &bg_windows_[rand_index % bg_windows_.size()];
 
-      cv::Mat cv_img = cv::imread(image.first, CV_LOAD_IMAGE_COLOR);
-      if (!cv_img.data) {
-        LOG(ERROR) << "Could not open or find file " << image.first;
-        return reinterpret_cast<void*>(NULL);
-      }
-      const int channels = cv_img.channels();
-
-      // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Dtype>::X1];
-      int y1 = window[WindowDataLayer<Dtype>::Y1];
-      int x2 = window[WindowDataLayer<Dtype>::X2];
-      int y2 = window[WindowDataLayer<Dtype>::Y2];
-
-      int pad_w = 0;
-      int pad_h = 0;
-      if (context_pad > 0 || use_square) {
-        // scale factor by which to expand the original region
-        // such that after warping the expanded region to crop_size x crop_size
-        // there's exactly context_pad amount of padding on each side
-        Dtype context_scale = static_cast<Dtype>(crop_size) /
-            static_cast<Dtype>(crop_size - 2*context_pad);
-
-        // compute the expanded region
-        Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
-        Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
-        Dtype center_x = static_cast<Dtype>(x1) + half_width;
-        Dtype center_y = static_cast<Dtype>(y1) + half_height;
-        if (use_square) {
-          if (half_height > half_width) {
-            half_width = half_height;
-          } else {
-            half_height = half_width;
-          }
-        }
-        x1 = static_cast<int>(round(center_x - half_width*context_scale));
-        x2 = static_cast<int>(round(center_x + half_width*context_scale));
-        y1 = static_cast<int>(round(center_y - half_height*context_scale));
-        y2 = static_cast<int>(round(center_y + half_height*context_scale));
-
-        // the expanded region may go outside of the image
-        // so we compute the clipped (expanded) region and keep track of
-        // the extent beyond the image
-        int unclipped_height = y2-y1+1;
-        int unclipped_width = x2-x1+1;
-        int pad_x1 = std::max(0, -x1);
-        int pad_y1 = std::max(0, -y1);
-        int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
-        int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
-        // clip bounds
-        x1 = x1 + pad_x1;
-        x2 = x2 - pad_x2;
-        y1 = y1 + pad_y1;
-        y2 = y2 - pad_y2;
-        CHECK_GT(x1, -1);
-        CHECK_GT(y1, -1);
-        CHECK_LT(x2, cv_img.cols);
-        CHECK_LT(y2, cv_img.rows);
-
-        int clipped_height = y2-y1+1;
-        int clipped_width = x2-x1+1;
-
-        // scale factors that would be used to warp the unclipped
-        // expanded region
-        Dtype scale_x =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
-        Dtype scale_y =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
-
-        // size to warp the clipped expanded region to
-        cv_crop_size.width =
-            static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
-        cv_crop_size.height =
-            static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
-        pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
-        pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
-        pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
-        pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
-
-        pad_h = pad_y1;
-        // if we're mirroring, we mirror the padding too (to be pedantic)
-        if (do_mirror) {
-          pad_w = pad_x2;
-        } else {
-          pad_w = pad_x1;
-        }
-
-        // ensure that the warped, clipped region plus the padding fits in the
-        // crop_size x crop_size image (it might not due to rounding)
-        if (pad_h + cv_crop_size.height > crop_size) {
-          cv_crop_size.height = crop_size - pad_h;
-        }
-        if (pad_w + cv_crop_size.width > crop_size) {
-          cv_crop_size.width = crop_size - pad_w;
-        }
-      }
+  batch_mirror_[item_id] = mirror && (*rng)() % 2;
+}
+
+template <typename Dtype>
+bool WindowDataLayer<Dtype>::LoadImage(const int image_index,
+    cv::Mat* cv_img, shared_ptr<const Datum>* cached) {
+  const string& path = image_database_[image_index].first;
+  if (cache_) {
+    *cached = cache_->Get(image_index);
+  }
+  if (!*cached) {
+    *cv_img = cv::imread(path, CV_LOAD_IMAGE_COLOR);
+    if (!cv_img->data) {
+      LOG(ERROR) << "Could not open or find file " << path;
+      return false;
+    }
+    if (!cache_) {
+      return true;
+    }
+    // The cache keeps the decoded rows as they are, channels interleaved.
+    const int row_bytes = cv_img->cols * cv_img->channels();
+    shared_ptr<Datum> datum(new Datum());
+    datum->set_channels(cv_img->channels());
+    datum->set_height(cv_img->rows);
+    datum->set_width(cv_img->cols);
+    string* data = datum->mutable_data();
+    data->resize(row_bytes * cv_img->rows);
+    for (int h = 0; h < cv_img->rows; ++h) {
+      memcpy(&(*data)[h * row_bytes], cv_img->ptr<uint8_t>(h), row_bytes);
+    }
+    cache_->Put(image_index, datum);
+    *cached = datum;
+  }
+  // Shared with other workers and later windows: strictly read-only.
+  // WarpWindow resizes and flips into an image of its own.
+  *cv_img = cv::Mat((*cached)->height(), (*cached)->width(),
+      CV_8UC((*cached)->channels()),
+      const_cast<char*>((*cached)->data().data()));
+  return true;
+}
 
-      cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
-      cv::Mat cv_cropped_img = cv_img(roi);
-      cv::resize(cv_cropped_img, cv_cropped_img,
-          cv_crop_size, 0, 0, cv::INTER_LINEAR);
+template <typename Dtype>
+void WindowDataLayer<Dtype>::WarpWindow(const int item_id,
+    const cv::Mat& cv_img, Dtype* top_data, Dtype* top_label) {
+  const Dtype scale = this->layer_param_.window_data_param().scale();
+  const int crop_size = this->layer_param_.window_data_param().crop_size();
+  const int context_pad = this->layer_param_.window_data_param().context_pad();
+  const Dtype* mean = data_mean_.cpu_data();
+  const int mean_off = (data_mean_.width() - crop_size) / 2;
+  const int mean_width = data_mean_.width();
+  const int mean_height = data_mean_.height();
+  cv::Size cv_crop_size(crop_size, crop_size);
+  const string& crop_mode = this->layer_param_.window_data_param().crop_mode();
 
-      // horizontal flip at random
-      if (do_mirror) {
-        cv::flip(cv_cropped_img, cv_cropped_img, 1);
-      }
+  bool use_square = (crop_mode == "square") ? true : false;
 
-      // copy the warped window into top_data
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < cv_cropped_img.rows; ++h) {
-          for (int w = 0; w < cv_cropped_img.cols; ++w) {
-            Dtype pixel =
-                static_cast<Dtype>(cv_cropped_img.at<cv::Vec3b>(h, w)[c]);
-
-            top_data[((item_id * channels + c) * crop_size + h + pad_h)
-                     * crop_size + w + pad_w]
-                = (pixel
-                    - mean[(c * mean_height + h + mean_off + pad_h)
-                           * mean_width + w + mean_off + pad_w])
-                  * scale;
-          }
-        }
+  const vector<float>& window = *batch_windows_[item_id];
+  const bool do_mirror = batch_mirror_[item_id];
+  const int channels = cv_img.channels();
+
+  // crop window out of image and warp it
+  int x1 = window[WindowDataLayer<Dtype>::X1];
+  int y1 = window[WindowDataLayer<Dtype>::Y1];
+  int x2 = window[WindowDataLayer<Dtype>::X2];
+  int y2 = window[WindowDataLayer<Dtype>::Y2];
+
+  int pad_w = 0;
+  int pad_h = 0;
+  if (context_pad > 0 || use_square) {
+    // scale factor by which to expand the original region
+    // such that after warping the expanded region to crop_size x crop_size
+    // there's exactly context_pad amount of padding on each side
+    Dtype context_scale = static_cast<Dtype>(crop_size) /
+        static_cast<Dtype>(crop_size - 2*context_pad);
+
+    // compute the expanded region
+    Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
+    Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
+    Dtype center_x = static_cast<Dtype>(x1) + half_width;
+    Dtype center_y = static_cast<Dtype>(y1) + half_height;
+    if (use_square) {
+      if (half_height > half_width) {
+        half_width = half_height;
+      } else {
+        half_height = half_width;
       }
+    }
+    x1 = static_cast<int>(round(center_x - half_width*context_scale));
+    x2 = static_cast<int>(round(center_x + half_width*context_scale));
+    y1 = static_cast<int>(round(center_y - half_height*context_scale));
+    y2 = static_cast<int>(round(center_y + half_height*context_scale));
+
+    // the expanded region may go outside of the image
+    // so we compute the clipped (expanded) region and keep track of
+    // the extent beyond the image
+    int unclipped_height = y2-y1+1;
+    int unclipped_width = x2-x1+1;
+    int pad_x1 = std::max(0, -x1);
+    int pad_y1 = std::max(0, -y1);
+    int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
+    int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
+    // clip bounds
+    x1 = x1 + pad_x1;
+    x2 = x2 - pad_x2;
+    y1 = y1 + pad_y1;
+    y2 = y2 - pad_y2;
+    CHECK_GT(x1, -1);
+    CHECK_GT(y1, -1);
+    CHECK_LT(x2, cv_img.cols);
+    CHECK_LT(y2, cv_img.rows);
+
+    int clipped_height = y2-y1+1;
+    int clipped_width = x2-x1+1;
+
+    // scale factors that would be used to warp the unclipped
+    // expanded region
+    Dtype scale_x =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
+    Dtype scale_y =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
+
+    // size to warp the clipped expanded region to
+    cv_crop_size.width =
+        static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
+    cv_crop_size.height =
+        static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
+    pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
+    pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
+    pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
+    pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
+
+    pad_h = pad_y1;
+    // if we're mirroring, we mirror the padding too (to be pedantic)
+    if (do_mirror) {
+      pad_w = pad_x2;
+    } else {
+      pad_w = pad_x1;
+    }
 
-      // get window label
-      top_label[item_id] = window[WindowDataLayer<Dtype>::LABEL];
-
-      #if 0
-      // useful debugging code for dumping transformed windows to disk
-      string file_id;
-      std::stringstream ss;
-      ss << layer->PrefetchRand();
-      ss >> file_id;
-      std::ofstream inf((string("dump/") + file_id +
-          string("_info.txt")).c_str(), std::ofstream::out);
-      inf << image.first << std::endl
-          << window[WindowDataLayer<Dtype>::X1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::X2]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y2]+1 << std::endl
-          << do_mirror << std::endl
-          << top_label[item_id] << std::endl
-          << is_fg << std::endl;
-      inf.close();
-      std::ofstream top_data_file((string("dump/") + file_id +
-          string("_data.txt")).c_str(),
-          std::ofstream::out | std::ofstream::binary);
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            top_data_file.write(reinterpret_cast<char*>(
-                &top_data[((item_id * channels + c) * crop_size + h)
-                          * crop_size + w]),
-                sizeof(Dtype));
-          }
-        }
-      }
-      top_data_file.close();
-      #endif
+    // ensure that the warped, clipped region plus the padding fits in the
+    // crop_size x crop_size image (it might not due to rounding)
+    if (pad_h + cv_crop_size.height > crop_size) {
+      cv_crop_size.height = crop_size - pad_h;
+    }
+    if (pad_w + cv_crop_size.width > crop_size) {
+      cv_crop_size.width = crop_size - pad_w;
+    }
+  }
+
+  // cv_img may be a cached image shared between workers, and resizing a
+  // window of the same size is a no-op that would leave the flip writing
+  // into it, so warp into a new image.
+  cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
+  cv::Mat cv_cropped_img;
+  cv::resize(cv_img(roi), cv_cropped_img,
+      cv_crop_size, 0, 0, cv::INTER_LINEAR);
+
+  // horizontal flip at random
+  if (do_mirror) {
+    cv::flip(cv_cropped_img, cv_cropped_img, 1);
+  }
 
-      item_id++;
+  // copy the warped window into top_data
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < cv_cropped_img.rows; ++h) {
+      // cv::Mat rows hold interleaved channels.
+      const uint8_t* pixels = cv_cropped_img.ptr<uint8_t>(h) + c;
+      caffe_transform_row(cv_cropped_img.cols, pixels, channels,
+          mean + (c * mean_height + h + mean_off + pad_h) * mean_width
+              + mean_off + pad_w,
+          scale, false,
+          top_data + ((item_id * channels + c) * crop_size + h + pad_h)
+              * crop_size + pad_w);
     }
   }
 
-  return reinterpret_cast<void*>(NULL);
+  // get window label
+  top_label[item_id] = window[WindowDataLayer<Dtype>::LABEL];
+
+  #if 0
+  // useful debugging code for dumping transformed windows to disk
+  string file_id;
+  std::stringstream ss;
+  ss << item_id << "_" << window[WindowDataLayer<Dtype>::X1];
+  ss >> file_id;
+  std::ofstream inf((string("dump/") + file_id +
+      string("_info.txt")).c_str(), std::ofstream::out);
+  inf << image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]].first
+      << std::endl
+      << window[WindowDataLayer<Dtype>::X1]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::Y1]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::X2]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::Y2]+1 << std::endl
+      << do_mirror << std::endl
+      << top_label[item_id] << std::endl;
+  inf.close();
+  std::ofstream top_data_file((string("dump/") + file_id +
+      string("_data.txt")).c_str(),
+      std::ofstream::out | std::ofstream::binary);
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        top_data_file.write(reinterpret_cast<char*>(
+            &top_data[((item_id * channels + c) * crop_size + h)
+                      * crop_size + w]),
+            sizeof(Dtype));
+      }
+    }
+  }
+  top_data_file.close();
+  #endif
 }
 
 template <typename Dtype>
@@ -385,6 +468,21 @@ void WindowDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
   (*top)[1]->Reshape(batch_size, 1, 1, 1);
   prefetch_label_.reset(
       new Blob<Dtype>(batch_size, 1, 1, 1));
+  workers_.reset(new WorkerPool(
+      this->layer_param_.window_data_param().num_workers()));
+  LOG(INFO) << "Loading windows with " << workers_->num_workers()
+      << " workers.";
+  batch_windows_.resize(batch_size);
+  batch_mirror_.resize(batch_size);
+  if (this->layer_param_.window_data_param().group_by_image()) {
+    LOG(INFO) << "Grouping the windows of each batch by image.";
+  }
+  const int cache_size_mb =
+      this->layer_param_.window_data_param().cache_size_mb();
+  if (cache_size_mb > 0) {
+    cache_.reset(new ImageCache(static_cast<size_t>(cache_size_mb) << 20));
+    LOG(INFO) << "Caching up to " << cache_size_mb << "MB of images.";
+  }
 
   // check if we want to have mean
   if (this->layer_param_.window_data_param().has_mean_file()) {
@@ -401,6 +499,9 @@ void WindowDataLayer<Dtype>::SetUp(const vector<Blob<Dtype>*>& bottom,
     // Simply initialize an all-empty mean.
     data_mean_.Reshape(1, channels, crop_size, crop_size);
   }
+  this->TrackMemory(&data_mean_, MemoryTracker::WORKSPACE);
+  this->TrackMemory(prefetch_data_.get(), MemoryTracker::PREFETCH);
+  this->TrackMemory(prefetch_label_.get(), MemoryTracker::PREFETCH);
   // Now, start the prefetch thread. Before calling prefetch, we make two
   // cpu_data calls so that the prefetch thread does not accidentally make
   // simultaneous cudaMalloc calls when the main thread is running. In some
@@ -427,7 +528,7 @@ void WindowDataLayer<Dtype>::CreatePrefetchThread() {
   // Create the thread.
   //CHECK(!pthread_create(&thread_, NULL, WindowDataLayerPrefetch<Dtype>,
   //      static_cast<void*>(this))) << "Pthread execution failed.";
-  thread_ = thread(WindowDataLayerPrefetch<Dtype>,reinterpret_cast<void*>(this));
+  thread_ = std::thread(WindowDataLayerPrefetch<Dtype>,reinterpret_cast<void*>(this));
 }
 
 template <typename Dtype>
@@ -1,7 +1,11 @@
 // Copyright 2014 BVLC and contributors.
 
+#include <cuda_runtime.h>
+
+#include <cstring>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -38,6 +42,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   InsertSplits(in_param, &param);
   // Basically, build all the layers and set up its connections.
   name_ = param.name();
+  memory_tracker_.reset(new MemoryTracker());
+  inference_only_ = param.inference_only();
+  forwarded_ = false;
+  CHECK(!inference_only_ || !param.force_backward())
+      << "An inference-only net cannot force backward.";
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   int num_layers = param.layers_size();
@@ -52,6 +61,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
                         param.input_dim(i * 4 + 1),
                         param.input_dim(i * 4 + 2),
                         param.input_dim(i * 4 + 3)));
+    blob_pointer->TrackMemory(memory_tracker_, blob_name,
+        MemoryTracker::DATA, MemoryTracker::DIFF);
+    if (inference_only_) {
+      blob_pointer->DisableDiff();
+    }
     blobs_.push_back(blob_pointer);
     blob_names_.push_back(blob_name);
     blob_need_backward_.push_back(param.force_backward());
@@ -110,6 +124,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
         // Normal output.
         LOG(INFO) << layer_param.name() << " -> " << blob_name;
         shared_ptr<Blob<Dtype> > blob_pointer(new Blob<Dtype>());
+        blob_pointer->TrackMemory(memory_tracker_, blob_name,
+            MemoryTracker::DATA, MemoryTracker::DIFF);
+        if (inference_only_) {
+          blob_pointer->DisableDiff();
+        }
         blobs_.push_back(blob_pointer);
         blob_names_.push_back(blob_name);
         blob_need_backward_.push_back(param.force_backward());
@@ -121,7 +140,15 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     }
     // After this layer is connected, set it up.
     //LOG(INFO) << "Setting up " << layer_names_[i];
+    layers_[i]->set_memory_tracker(memory_tracker_, layer_param.name());
     layers_[i]->SetUp(bottom_vecs_[i], &(top_vecs_[i]));
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      layers_[i]->blobs()[j]->TrackMemory(memory_tracker_, layer_param.name(),
+          MemoryTracker::PARAM, MemoryTracker::PARAM);
+      if (inference_only_) {
+        layers_[i]->blobs()[j]->DisableDiff();
+      }
+    }
     for (int topid = 0; topid < top_vecs_[i].size(); ++topid) {
       LOG(INFO) << "Top shape: " << top_vecs_[i][topid]->num() << " "
           << top_vecs_[i][topid]->channels() << " "
@@ -132,6 +159,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
         memory_used += top_vecs_[i][topid]->count();
     }
     DLOG(INFO) << "Memory  required for Data " << memory_used*sizeof(Dtype);
+    if (inference_only_) {
+      layer_need_backward_.push_back(false);
+      continue;
+    }
     int blobs_lr_size = layers_[i]->layer_param().blobs_lr_size();
     CHECK(blobs_lr_size == layers_[i]->blobs().size() || blobs_lr_size == 0)
         << "Incorrect blobs lr size: should be either 0 or the same as "
@@ -170,12 +201,117 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t i = 0; i < layer_names_.size(); ++i) {
     layer_names_index_[layer_names_[i]] = i;
   }
+  share_activations_ = param.share_activations();
+  if (share_activations_) {
+    ShareActivations();
+  }
   GetLearningRateAndWeightDecay();
+  profiling_ = false;
+  layer_profiles_.assign(layers_.size(), LayerProfile());
   LOG(INFO) << "Network initialization done.";
   LOG(INFO) << "Memory required for Data " << memory_used*sizeof(Dtype);
 }
 
 
+template <typename Dtype>
+void Net<Dtype>::ShareActivations() {
+  const int num_blobs = blobs_.size();
+  // The first and last layer using the data of each blob. Blobs that are
+  // filled or read outside of the net keep their own memory.
+  vector<int> first_use(num_blobs, -1);
+  vector<int> last_use(num_blobs, -1);
+  vector<bool> keep(num_blobs, false);
+  blob_alias_roots_.resize(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) {
+    blob_alias_roots_[i] = i;
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    const LayerParameter_LayerType type = layers_[i]->layer_param().type();
+    // These layers point their tops at the data of their bottom.
+    const bool aliases = (type == LayerParameter_LayerType_SPLIT ||
+                          type == LayerParameter_LayerType_FLATTEN);
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      last_use[blob_alias_roots_[bottom_id_vecs_[i][j]]] = i;
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (aliases) {
+        blob_alias_roots_[blob_id] = blob_alias_roots_[bottom_id_vecs_[i][0]];
+      }
+      const int root = blob_alias_roots_[blob_id];
+      if (first_use[root] < 0) {
+        first_use[root] = i;
+      }
+      last_use[root] = i;
+      // Data layers may swap the memory of their tops.
+      if (bottom_id_vecs_[i].empty()) {
+        keep[blob_id] = true;
+      }
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    keep[blob_alias_roots_[net_output_blob_indices_[i]]] = true;
+  }
+  // Blobs are numbered in the order of the layers that produce them. Give
+  // each the smallest free buffer that is large enough, or else grow the
+  // largest free one.
+  vector<size_t> buffer_sizes;
+  vector<int> buffer_last_use;
+  blob_buffer_ids_.assign(num_blobs, -1);
+  size_t blob_bytes = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const size_t size = blobs_[blob_id]->count() * sizeof(Dtype);
+    if (keep[blob_id] || blob_alias_roots_[blob_id] != blob_id || !size) {
+      continue;
+    }
+    int best = -1;
+    for (int b = 0; b < buffer_sizes.size(); ++b) {
+      if (buffer_last_use[b] >= first_use[blob_id]) {
+        continue;
+      }
+      const bool fits = buffer_sizes[b] >= size;
+      const bool best_fits = best >= 0 && buffer_sizes[best] >= size;
+      if (best < 0 || (fits && !best_fits) ||
+          (fits && buffer_sizes[b] < buffer_sizes[best]) ||
+          (!best_fits && buffer_sizes[b] > buffer_sizes[best])) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_sizes.size();
+      buffer_sizes.push_back(0);
+      buffer_last_use.push_back(-1);
+    }
+    buffer_sizes[best] = std::max(buffer_sizes[best], size);
+    buffer_last_use[best] = last_use[blob_id];
+    blob_buffer_ids_[blob_id] = best;
+    blob_bytes += size;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers;
+  const int tag = memory_tracker_->Register("shared activations",
+      MemoryTracker::DATA);
+  size_t buffer_bytes = 0;
+  for (int b = 0; b < buffer_sizes.size(); ++b) {
+    buffers.push_back(shared_ptr<SyncedMemory>(
+        new SyncedMemory(buffer_sizes[b])));
+    buffers[b]->set_tracker(memory_tracker_, tag);
+    buffer_bytes += buffer_sizes[b];
+  }
+  int num_shared = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blob_buffer_ids_[blob_id] >= 0) {
+      blobs_[blob_id]->set_data(buffers[blob_buffer_ids_[blob_id]]);
+      ++num_shared;
+    }
+  }
+  LOG(INFO) << "Sharing the data of " << num_shared << " blobs in "
+      << buffers.size() << " buffers: " << buffer_bytes / 1048576.
+      << " MB instead of " << blob_bytes / 1048576. << " MB";
+}
+
 template <typename Dtype>
 void Net<Dtype>::GetLearningRateAndWeightDecay() {
   LOG(INFO) << "Collecting Learning Rate and Weight Decay.";
@@ -221,11 +357,22 @@ const vector<Blob<Dtype>*>& Net<Dtype>::ForwardPrefilled(Dtype* loss) {
   }
   for (int i = 0; i < layers_.size(); ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (profiling_) {
+      profile_timer_->Start();
+    }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], &top_vecs_[i]);
+    if (profiling_) {
+      LayerProfile& profile = layer_profiles_[i];
+      profile.forward.Add(profile_timer_->MicroSeconds() / 1000.);
+      for (int j = 0; j < top_vecs_[i].size(); ++j) {
+        profile.top_bytes += top_vecs_[i][j]->count() * sizeof(Dtype);
+      }
+    }
     if (loss != NULL) {
       *loss += layer_loss;
     }
   }
+  forwarded_ = true;
   return net_output_blobs_;
 }
 
@@ -263,9 +410,19 @@ string Net<Dtype>::Forward(const string& input_blob_protos, Dtype* loss) {
 
 template <typename Dtype>
 void Net<Dtype>::Backward() {
+  CHECK(!share_activations_)
+      << "Backward is not possible in a net with share_activations.";
+  CHECK(!inference_only_) << "Backward is not possible in an inference-only "
+      "net.";
   for (int i = layers_.size() - 1; i >= 0; --i) {
     if (layer_need_backward_[i]) {
+      if (profiling_) {
+        profile_timer_->Start();
+      }
       layers_[i]->Backward(top_vecs_[i], true, &bottom_vecs_[i]);
+      if (profiling_) {
+        layer_profiles_[i].backward.Add(profile_timer_->MicroSeconds() / 1000.);
+      }
     }
   }
 }
@@ -338,6 +495,34 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   CopyTrainedLayersFrom(param);
 }
 
+template <typename Dtype>
+void Net<Dtype>::GetDataCursors(
+    google::protobuf::RepeatedPtrField<DataCursor>* cursors) {
+  cursors->Clear();
+  for (int i = 0; i < layers_.size(); ++i) {
+    DataCursor cursor;
+    if (layers_[i]->GetDataCursor(&cursor)) {
+      cursor.set_layer(layer_names_[i]);
+      cursors->Add()->CopyFrom(cursor);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::SeekDataCursors(
+    const google::protobuf::RepeatedPtrField<DataCursor>& cursors) {
+  for (int i = 0; i < cursors.size(); ++i) {
+    const string& layer_name = cursors.Get(i).layer();
+    if (!has_layer(layer_name)) {
+      LOG(WARNING) << "Ignoring the data cursor of missing layer "
+          << layer_name;
+      continue;
+    }
+    LOG(INFO) << "Seeking data layer " << layer_name << " to where it was.";
+    layer_by_name(layer_name)->SeekDataCursor(cursors.Get(i));
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) {
   param->Clear();
@@ -376,7 +561,43 @@ const shared_ptr<Blob<Dtype> > Net<Dtype>::blob_by_name(
     const string& blob_name) {
   shared_ptr<Blob<Dtype> > blob_ptr;
   if (has_blob(blob_name)) {
-    blob_ptr = blobs_[blob_names_index_[blob_name]];
+    const int blob_id = blob_names_index_[blob_name];
+    const int root = share_activations_ ? blob_alias_roots_[blob_id] : blob_id;
+    if (share_activations_ && blob_buffer_ids_[root] >= 0) {
+      // Give the blob, or the blob it aliases, its own memory, holding what
+      // the last Forward left in the shared buffer.
+      Blob<Dtype>* blob = blobs_[root].get();
+      const size_t size = blob->count() * sizeof(Dtype);
+      shared_ptr<SyncedMemory> memory(new SyncedMemory(size));
+      memory->set_tracker(memory_tracker_,
+          memory_tracker_->Register(blob_names_[root], MemoryTracker::DATA));
+      switch (blob->data()->head()) {
+      case SyncedMemory::HEAD_AT_CPU:
+      case SyncedMemory::SYNCED:
+        memcpy(memory->mutable_cpu_data(), blob->cpu_data(), size);
+        break;
+      case SyncedMemory::HEAD_AT_GPU:
+        CUDA_CHECK(cudaMemcpy(memory->mutable_gpu_data(), blob->gpu_data(),
+            size, cudaMemcpyDeviceToDevice));
+        break;
+      default:
+        break;
+      }
+      // Blobs are numbered in the order they are produced, so a later blob
+      // in the same buffer has overwritten the data of the last Forward.
+      for (int i = root + 1; forwarded_ && i < blobs_.size(); ++i) {
+        if (blob_buffer_ids_[i] == blob_buffer_ids_[root]) {
+          LOG(WARNING) << "Blob " << blob_names_[root] << " was overwritten "
+              "by " << blob_names_[i] << " in the last Forward; it holds its "
+              "own data from the next Forward on";
+          break;
+        }
+      }
+      blob->set_data(memory);
+      blob_buffer_ids_[root] = -1;
+      LOG(INFO) << "Blob " << blob_names_[root] << " no longer shares memory";
+    }
+    blob_ptr = blobs_[blob_id];
   } else {
     blob_ptr.reset((Blob<Dtype>*)(NULL));
     LOG(WARNING) << "Unknown blob name " << blob_name;
@@ -402,6 +623,53 @@ const shared_ptr<Layer<Dtype> > Net<Dtype>::layer_by_name(
   return layer_ptr;
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_profiling(bool profiling) {
+  // The timer records CUDA events in GPU mode, so it is created in the mode
+  // the net will run in.
+  if (profiling && !profiling_) {
+    profile_timer_.reset(new Timer());
+  }
+  profiling_ = profiling;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ResetProfile() {
+  layer_profiles_.assign(layers_.size(), LayerProfile());
+}
+
+template <typename Dtype>
+void Net<Dtype>::LogProfile() {
+  double total_ms = 0;
+  for (int i = 0; i < layer_profiles_.size(); ++i) {
+    total_ms += layer_profiles_[i].forward.total_ms +
+        layer_profiles_[i].backward.total_ms;
+  }
+  for (int i = 0; i < layer_profiles_.size(); ++i) {
+    const LayerProfile& profile = layer_profiles_[i];
+    if (profile.forward.count == 0 && profile.backward.count == 0) {
+      continue;
+    }
+    std::ostringstream line;
+    line << layer_names_[i];
+    const PassProfile* passes[] = { &profile.forward, &profile.backward };
+    const char* pass_names[] = { "forward", "backward" };
+    for (int p = 0; p < 2; ++p) {
+      if (passes[p]->count == 0) {
+        continue;
+      }
+      line << "\t" << pass_names[p] << ": " << passes[p]->count << " x "
+          << passes[p]->total_ms / passes[p]->count << " ms (min "
+          << passes[p]->min_ms << ", max " << passes[p]->max_ms << ")";
+    }
+    line << "\t" << (total_ms > 0 ? 100. * (profile.forward.total_ms +
+        profile.backward.total_ms) / total_ms : 0.) << "%";
+    line << "\ttop " << profile.top_bytes / 1048576. << " MB";
+    LOG(INFO) << line.str();
+  }
+  LOG(INFO) << "Profiled layers took " << total_ms << " ms in total.";
+}
+
 INSTANTIATE_CLASS(Net);
 
 }  // namespace caffe
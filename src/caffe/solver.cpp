@@ -10,8 +10,10 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 
 using std::max;
 using std::min;
@@ -60,6 +62,11 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   }
   Caffe::set_phase(Caffe::TRAIN);
   LOG(INFO) << "Solving " << net_->name();
+  if (param_.has_trace_file()) {
+    Tracer::set_buffer_size(param_.trace_buffer_size());
+    Tracer::Enable();
+  }
+  net_->set_profiling(param_.profile());
   PreSolve();
 
   iter_ = 0;
@@ -74,18 +81,37 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   // the effect of the first training iterations.
   if (param_.test_interval()) {
     Test();
+    test_net_->memory_tracker()->Log("test net");
   }
 
   // For a network that is trained by the solver, no bottom or top vecs
   // should be given, and we will just provide dummy vecs.
   vector<Blob<Dtype>*> bottom_vec;
+  // Memory is allocated on first use, so it is reported after an iteration.
+  bool memory_logged = false;
   while (iter_++ < param_.max_iter()) {
     Dtype loss = net_->ForwardBackward(bottom_vec);
-    ComputeUpdateValue();
-    net_->Update();
+    {
+      TraceScope trace("ComputeUpdateValue", "solver");
+      ComputeUpdateValue();
+    }
+    {
+      TraceScope trace("Update", "solver");
+      net_->Update();
+    }
+    if (!memory_logged) {
+      net_->memory_tracker()->Log("train net");
+      memory_logged = true;
+    }
 
     if (param_.display() && iter_ % param_.display() == 0) {
       LOG(INFO) << "Iteration " << iter_ << ", loss = " << loss;
+      if (net_->profiling()) {
+        net_->LogProfile();
+        net_->ResetProfile();
+        net_->memory_tracker()->Log("train net");
+        HostMemoryPool::Get().LogStats();
+      }
     }
     if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
       Test();
@@ -104,6 +130,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
 
 template <typename Dtype>
 void Solver<Dtype>::Test() {
+  TraceScope trace("Test", "solver");
   LOG(INFO) << "Iteration " << iter_ << ", Testing net";
   // We need to set phase to test before running.
   Caffe::set_phase(Caffe::TEST);
@@ -157,6 +184,18 @@ void Solver<Dtype>::Test() {
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
+  {
+    TraceScope trace("Snapshot", "solver");
+    SnapshotNetAndState();
+  }
+  if (param_.has_trace_file()) {
+    LOG(INFO) << "Writing the trace to " << param_.trace_file();
+    Tracer::WriteChromeTrace(param_.trace_file());
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotNetAndState() {
   NetParameter net_param;
   // For intermediate results, we will also dump the gradient values.
   net_->ToProto(&net_param, param_.snapshot_diff());
@@ -169,6 +208,7 @@ void Solver<Dtype>::Snapshot() {
   WriteProtoToBinaryFile(net_param, filename.c_str());
   SolverState state;
   SnapshotSolverState(&state);
+  net_->GetDataCursors(state.mutable_data_cursor());
   state.set_iter(iter_);
   state.set_learned_net(filename);
   filename += ".solverstate";
@@ -186,6 +226,8 @@ void Solver<Dtype>::Restore(const char* state_file) {
     net_->CopyTrainedLayersFrom(net_param);
   }
   iter_ = state.iter();
+  // Older snapshots have no cursors, and their data layers restart.
+  net_->SeekDataCursors(state.data_cursor());
   RestoreSolverState(state);
 }
 
@@ -232,6 +274,17 @@ void SGDSolver<Dtype>::PreSolve() {
         net_param->num(), net_param->channels(), net_param->height(),
         net_param->width())));
   }
+  // The params are in the order of the layers and their blobs; count the
+  // history of each under its layer.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = this->net_->layers();
+  int param_id = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    for (int j = 0; j < layers[i]->blobs().size(); ++j, ++param_id) {
+      history_[param_id]->TrackMemory(this->net_->memory_tracker(),
+          this->net_->layer_names()[i], MemoryTracker::HISTORY,
+          MemoryTracker::HISTORY);
+    }
+  }
 }
 
 
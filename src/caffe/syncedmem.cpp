@@ -11,7 +11,10 @@ namespace caffe {
 
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_);
+    if (tracker_) {
+      tracker_->Free(tracker_tag_, size_);
+    }
+    CaffeFreeHost(cpu_ptr_, size_);
 	cpu_ptr_ = NULL;
   }
 
@@ -25,6 +28,9 @@ inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_);
+    if (tracker_) {
+      tracker_->Allocate(tracker_tag_, size_);
+    }
     memset(cpu_ptr_, 0, size_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -32,6 +38,9 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_GPU:
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_);
+      if (tracker_) {
+        tracker_->Allocate(tracker_tag_, size_);
+      }
       own_cpu_data_ = true;
     }
     CUDA_CHECK(cudaMemcpy(cpu_ptr_, gpu_ptr_, size_, cudaMemcpyDeviceToHost));
@@ -71,7 +80,10 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_);
+    if (tracker_) {
+      tracker_->Free(tracker_tag_, size_);
+    }
+    CaffeFreeHost(cpu_ptr_, size_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
@@ -95,6 +107,20 @@ void* SyncedMemory::mutable_gpu_data() {
   return gpu_ptr_;
 }
 
+void SyncedMemory::set_tracker(const shared_ptr<MemoryTracker>& tracker,
+    int tag) {
+  if (cpu_ptr_ && own_cpu_data_) {
+    if (tracker_) {
+      tracker_->Free(tracker_tag_, size_);
+    }
+    if (tracker) {
+      tracker->Allocate(tag, size_);
+    }
+  }
+  tracker_ = tracker;
+  tracker_tag_ = tag;
+}
+
 
 }  // namespace caffe
 
@@ -134,6 +134,62 @@ TEST_F(BenchmarkTest, TestTimerMilliSecondsGPU) {
   EXPECT_TRUE(timer.has_run_at_least_once());
 }
 
+TEST_F(BenchmarkTest, TestTimerMicroSecondsCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  Timer timer;
+  CHECK_EQ(timer.MicroSeconds(), 0);
+  EXPECT_TRUE(timer.initted());
+  EXPECT_FALSE(timer.running());
+  EXPECT_FALSE(timer.has_run_at_least_once());
+  timer.Start();
+  usleep(300 * 1000);
+  CHECK_GE(timer.MicroSeconds(), 298000);
+  CHECK_LE(timer.MicroSeconds(), 302000);
+  EXPECT_TRUE(timer.initted());
+  EXPECT_FALSE(timer.running());
+  EXPECT_TRUE(timer.has_run_at_least_once());
+}
+
+TEST_F(BenchmarkTest, TestTimerMicroSecondsGPU) {
+  Caffe::set_mode(Caffe::GPU);
+  Timer timer;
+  CHECK_EQ(timer.MicroSeconds(), 0);
+  EXPECT_TRUE(timer.initted());
+  EXPECT_FALSE(timer.running());
+  EXPECT_FALSE(timer.has_run_at_least_once());
+  timer.Start();
+  usleep(300 * 1000);
+  CHECK_GE(timer.MicroSeconds(), 298000);
+  CHECK_LE(timer.MicroSeconds(), 302000);
+  EXPECT_TRUE(timer.initted());
+  EXPECT_FALSE(timer.running());
+  EXPECT_TRUE(timer.has_run_at_least_once());
+}
+
+TEST_F(BenchmarkTest, TestTimerSubMilliSecondCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  Timer timer;
+  timer.Start();
+  usleep(500);
+  const float ms = timer.MilliSeconds();
+  EXPECT_GE(ms, 0.5);
+  // The old clock only counted whole milliseconds.
+  EXPECT_NE(ms, static_cast<int>(ms));
+  EXPECT_NEAR(timer.MicroSeconds(), ms * 1000, 1);
+}
+
+TEST_F(BenchmarkTest, TestMonotonicMicros) {
+  int64_t last = MonotonicMicros();
+  for (int i = 0; i < 1000; ++i) {
+    const int64_t now = MonotonicMicros();
+    EXPECT_GE(now, last);
+    last = now;
+  }
+  const int64_t start = MonotonicMicros();
+  usleep(500);
+  EXPECT_GE(MonotonicMicros() - start, 500);
+}
+
 TEST_F(BenchmarkTest, TestTimerSecondsCPU) {
   Caffe::set_mode(Caffe::CPU);
   Timer timer;
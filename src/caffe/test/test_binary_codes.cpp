@@ -0,0 +1,146 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/binary_codes.hpp"
+#include "caffe/util/worker_pool.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::pair;
+using std::vector;
+
+namespace caffe {
+
+class BinaryCodeTableTest : public ::testing::Test {
+ protected:
+  BinaryCodeTableTest() : rows_(500), dim_(100) {}
+  virtual void SetUp() {
+    features_.resize(rows_ * dim_);
+    unsigned int state = 1701;
+    for (int i = 0; i < features_.size(); ++i) {
+      state = state * 1103515245 + 12345;
+      features_[i] = static_cast<float>((state >> 16) % 1000) / 1000 - 0.5f;
+    }
+  }
+
+  // The k nearest rows to row query by brute force over the features.
+  void BruteForce(const int query, const int k,
+      vector<pair<int, int> >* results) {
+    results->clear();
+    for (int n = 0; n < rows_; ++n) {
+      int distance = 0;
+      for (int i = 0; i < dim_; ++i) {
+        distance += (features_[n * dim_ + i] > 0) !=
+            (features_[query * dim_ + i] > 0);
+      }
+      results->push_back(std::make_pair(distance, n));
+    }
+    std::sort(results->begin(), results->end());
+    results->resize(k);
+  }
+
+  const int rows_;
+  const int dim_;
+  vector<float> features_;
+};
+
+TEST_F(BinaryCodeTableTest, TestBinarize) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], rows_, dim_, 0);
+  EXPECT_EQ(rows_, table.num_codes());
+  EXPECT_EQ(dim_, table.num_bits());
+  EXPECT_EQ(2, table.words_per_code());
+  for (int n = 0; n < rows_; ++n) {
+    for (int i = 0; i < dim_; ++i) {
+      EXPECT_EQ(features_[n * dim_ + i] > 0,
+          (table.code(n)[i / 64] >> (i % 64)) & 1);
+    }
+    // The bits past num_bits stay clear.
+    EXPECT_EQ(0, table.code(n)[1] >> (dim_ - 64));
+  }
+}
+
+TEST_F(BinaryCodeTableTest, TestWriteRead) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], rows_, dim_, 0);
+  const string filename(tmpnam(NULL));
+  table.Write(filename);
+  BinaryCodeTable read;
+  ASSERT_TRUE(read.Read(filename));
+  EXPECT_EQ(rows_, read.num_codes());
+  EXPECT_EQ(dim_, read.num_bits());
+  for (int n = 0; n < rows_; ++n) {
+    for (int w = 0; w < table.words_per_code(); ++w) {
+      EXPECT_EQ(table.code(n)[w], read.code(n)[w]);
+    }
+  }
+  remove(filename.c_str());
+}
+
+TEST_F(BinaryCodeTableTest, TestSearch) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], rows_, dim_, 0);
+  const int k = 7;
+  for (int num_workers = 1; num_workers <= 4; ++num_workers) {
+    WorkerPool pool(num_workers);
+    for (int query = 0; query < rows_; query += 37) {
+      vector<uint64_t> code;
+      table.BinarizeQuery(&features_[query * dim_], 0, &code);
+      vector<pair<int, int> > expected, actual;
+      BruteForce(query, k, &expected);
+      table.Search(&code[0], k, &pool, &actual);
+      ASSERT_EQ(k, actual.size());
+      EXPECT_EQ(0, actual[0].first);
+      for (int i = 0; i < k; ++i) {
+        EXPECT_EQ(expected[i], actual[i]) << "debug: query " << query
+            << " i " << i << " num_workers " << num_workers;
+      }
+    }
+  }
+}
+
+TEST_F(BinaryCodeTableTest, TestSearchFewCodes) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], 3, dim_, 0);
+  WorkerPool pool(4);
+  vector<uint64_t> code;
+  table.BinarizeQuery(&features_[0], 0, &code);
+  vector<pair<int, int> > results;
+  table.Search(&code[0], 10, &pool, &results);
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ(std::make_pair(0, 0), results[0]);
+}
+
+TEST_F(BinaryCodeTableTest, TestSearchEmpty) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], 0, dim_, 0);
+  WorkerPool pool(4);
+  vector<uint64_t> code;
+  table.BinarizeQuery(&features_[0], 0, &code);
+  vector<pair<int, int> > results;
+  table.Search(&code[0], 10, NULL, &results);
+  EXPECT_EQ(0, results.size());
+  table.Search(&code[0], 10, &pool, &results);
+  EXPECT_EQ(0, results.size());
+}
+
+TEST_F(BinaryCodeTableTest, TestWriteReadEmpty) {
+  BinaryCodeTable table;
+  table.Binarize(&features_[0], 0, dim_, 0);
+  const string filename(tmpnam(NULL));
+  table.Write(filename);
+  BinaryCodeTable read;
+  ASSERT_TRUE(read.Read(filename));
+  EXPECT_EQ(0, read.num_codes());
+  EXPECT_EQ(dim_, read.num_bits());
+  remove(filename.c_str());
+}
+
+}  // namespace caffe
@@ -1,15 +1,19 @@
 // Copyright 2014 BVLC and contributors.
 
 #include <cstring>
+#include <vector>
 
 #include "cuda_runtime.h"
 #include "gtest/gtest.h"
 #include "caffe/common.hpp"
 #include "caffe/blob.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
+using std::vector;
+
 namespace caffe {
 
 template <typename Dtype>
@@ -57,4 +61,91 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestSwapData) {
+  Blob<TypeParam> other(2, 3, 4, 5);
+  this->blob_preshaped_->mutable_cpu_data()[0] = 1;
+  other.mutable_cpu_data()[0] = 2;
+  const TypeParam* preshaped_data = this->blob_preshaped_->cpu_data();
+  const TypeParam* other_data = other.cpu_data();
+  this->blob_preshaped_->SwapData(&other);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data(), other_data);
+  EXPECT_EQ(other.cpu_data(), preshaped_data);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data()[0], 2);
+  EXPECT_EQ(other.cpu_data()[0], 1);
+}
+
+TYPED_TEST(BlobSimpleTest, TestDisableDiff) {
+  Blob<TypeParam> other(1, 1, 1, 2);
+  other.mutable_cpu_data()[0] = 3;
+  other.mutable_cpu_diff()[0] = 4;
+  BlobProto proto;
+  other.ToProto(&proto, true);
+  this->blob_preshaped_->DisableDiff();
+  EXPECT_FALSE(this->blob_preshaped_->diff_enabled());
+  EXPECT_DEATH(this->blob_preshaped_->cpu_diff(), "diff of this blob is");
+  // Reshaping and loading a proto with a diff do not bring the diff back.
+  this->blob_preshaped_->FromProto(proto);
+  EXPECT_EQ(this->blob_preshaped_->count(), 2);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data()[0], 3);
+  EXPECT_FALSE(this->blob_preshaped_->diff_enabled());
+  EXPECT_DEATH(this->blob_preshaped_->mutable_cpu_diff(),
+               "diff of this blob is");
+  EXPECT_DEATH(this->blob_preshaped_->ToProto(&proto, true),
+               "diff of this blob is");
+}
+
+TYPED_TEST(BlobSimpleTest, TestReshapeKeepsMemory) {
+  const TypeParam* data = this->blob_preshaped_->cpu_data();
+  const TypeParam* diff = this->blob_preshaped_->cpu_diff();
+  // Shrinking and growing back within the capacity keeps the memory.
+  this->blob_preshaped_->Reshape(1, 3, 4, 5);
+  this->blob_preshaped_->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data(), data);
+  EXPECT_EQ(this->blob_preshaped_->cpu_diff(), diff);
+  this->blob_preshaped_->Reshape(3, 3, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->count(), 180);
+  EXPECT_GE(this->blob_preshaped_->data()->size(), 180 * sizeof(TypeParam));
+  EXPECT_GE(this->blob_preshaped_->diff()->size(), 180 * sizeof(TypeParam));
+}
+
+TYPED_TEST(BlobSimpleTest, TestReshapeEmpty) {
+  // An empty blob has no memory to read, rather than its old contents.
+  this->blob_preshaped_->Reshape(0, 3, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->count(), 0);
+  EXPECT_DEATH(this->blob_preshaped_->cpu_data(), "");
+  EXPECT_DEATH(this->blob_preshaped_->cpu_diff(), "");
+  this->blob_preshaped_->Reshape(1, 3, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(), 60 * sizeof(TypeParam));
+}
+
+TYPED_TEST(BlobSimpleTest, TestReshapeSharedData) {
+  Blob<TypeParam> source(2, 3, 4, 5);
+  TypeParam* source_data = source.mutable_cpu_data();
+  TypeParam* source_diff = source.mutable_cpu_diff();
+  for (int i = 0; i < source.count(); ++i) {
+    source_data[i] = i;
+    source_diff[i] = -i;
+  }
+  this->blob_preshaped_->ShareData(source);
+  this->blob_preshaped_->ShareDiff(source);
+  // Shrinking gives the blob memory of its own instead of writing through
+  // the source's.
+  this->blob_preshaped_->Reshape(1, 3, 4, 5);
+  EXPECT_NE(this->blob_preshaped_->data(), source.data());
+  EXPECT_NE(this->blob_preshaped_->diff(), source.diff());
+  caffe_set(this->blob_preshaped_->count(), TypeParam(7),
+      this->blob_preshaped_->mutable_cpu_data());
+  caffe_set(this->blob_preshaped_->count(), TypeParam(7),
+      this->blob_preshaped_->mutable_cpu_diff());
+  for (int i = 0; i < source.count(); ++i) {
+    EXPECT_EQ(i, source.cpu_data()[i]);
+    EXPECT_EQ(-i, source.cpu_diff()[i]);
+  }
+  // Nor does it write through memory set with set_cpu_data.
+  vector<TypeParam> external(source.count(), 1);
+  source.set_cpu_data(&external[0]);
+  source.Reshape(1, 1, 1, 10);
+  EXPECT_NE(source.cpu_data(), &external[0]);
+}
+
 }  // namespace caffe
@@ -0,0 +1,43 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/command_line.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CommandLineFlagsTest : public ::testing::Test {};
+
+TEST_F(CommandLineFlagsTest, TestParse) {
+  char* argv[] = { const_cast<char*>("tool"), const_cast<char*>("in"),
+      const_cast<char*>("--threads=4"), const_cast<char*>("out"),
+      const_cast<char*>("--name=a=b"), const_cast<char*>("--verbose"),
+      const_cast<char*>("--scale=0.5"), NULL };
+  int argc = 7;
+  CommandLineFlags flags(&argc, argv);
+  EXPECT_EQ(3, argc);
+  EXPECT_EQ(string("in"), argv[1]);
+  EXPECT_EQ(string("out"), argv[2]);
+  EXPECT_TRUE(flags.Has("threads"));
+  EXPECT_FALSE(flags.Has("shards"));
+  EXPECT_EQ(4, flags.GetInt("threads", 1));
+  EXPECT_EQ(1, flags.GetInt("shards", 1));
+  EXPECT_EQ(string("a=b"), flags.GetString("name", ""));
+  EXPECT_TRUE(flags.GetBool("verbose", false));
+  EXPECT_EQ(0.5, flags.GetDouble("scale", 1.));
+  flags.CheckAllUsed();
+}
+
+TEST_F(CommandLineFlagsTest, TestUnknownFlag) {
+  char* argv[] = { const_cast<char*>("tool"), const_cast<char*>("--thread=4"),
+      NULL };
+  int argc = 2;
+  CommandLineFlags flags(&argc, argv);
+  EXPECT_EQ(1, flags.GetInt("threads", 1));
+  EXPECT_DEATH(flags.CheckAllUsed(), "Unknown flag --thread");
+}
+
+}  // namespace caffe
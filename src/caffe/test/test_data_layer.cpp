@@ -1,16 +1,19 @@
 // Copyright 2014 BVLC and contributors.
 
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
 #include "cuda_runtime.h"
-#include "leveldb/db.h"
 #include "gtest/gtest.h"
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/vision_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 
 using std::string;
@@ -33,18 +36,14 @@ class DataLayerTest : public ::testing::Test {
     blob_top_vec_.push_back(blob_top_label_);
   }
 
-  // Fill the LevelDB with data: if unique_pixels, each pixel is unique but
+  // Fill the DB with data: if unique_pixels, each pixel is unique but
   // all images are the same; else each image is unique but all pixels within
   // an image are the same.
-  void FillLevelDB(const bool unique_pixels) {
-    LOG(INFO) << "Using temporary leveldb " << *filename_;
-    leveldb::DB* db;
-    leveldb::Options options;
-    options.error_if_exists = true;
-    options.create_if_missing = true;
-    leveldb::Status status =
-        leveldb::DB::Open(options, filename_->c_str(), &db);
-    CHECK(status.ok());
+  void Fill(const bool unique_pixels, DataParameter_DB backend) {
+    LOG(INFO) << "Using temporary database " << *filename_;
+    shared_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    shared_ptr<db::Transaction> txn(db->NewTransaction());
     for (int i = 0; i < 5; ++i) {
       Datum datum;
       datum.set_label(i);
@@ -58,9 +57,43 @@ class DataLayerTest : public ::testing::Test {
       }
       stringstream ss;
       ss << i;
-      db->Put(leveldb::WriteOptions(), ss.str(), datum.SerializeAsString());
+      txn->Put(ss.str(), datum.SerializeAsString());
     }
-    delete db;
+    txn->Commit();
+  }
+
+  void FillLevelDB(const bool unique_pixels) {
+    Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  }
+
+  // Reads epochs of shuffled records, checking that each holds every record
+  // once, and returns the labels in the order read.
+  vector<int> ReadShuffledEpochs(const LayerParameter& param,
+      const int num_epochs) {
+    const int batch_size = param.data_param().batch_size();
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    vector<int> labels;
+    while (labels.size() < num_epochs * 5) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+        labels.push_back(label);
+      }
+    }
+    for (int epoch = 0; epoch < num_epochs; ++epoch) {
+      vector<int> epoch_labels(labels.begin() + epoch * 5,
+                               labels.begin() + (epoch + 1) * 5);
+      std::sort(epoch_labels.begin(), epoch_labels.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, epoch_labels[i]) << "debug: epoch " << epoch;
+      }
+    }
+    labels.resize(num_epochs * 5);
+    return labels;
   }
 
   virtual ~DataLayerTest() { delete blob_top_data_; delete blob_top_label_; }
@@ -146,6 +179,316 @@ TYPED_TEST(DataLayerTest, TestReadGPU) {
   }
 }
 
+#ifdef USE_LMDB
+TYPED_TEST(DataLayerTest, TestReadLMDBCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const TypeParam scale = 3;
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(5);
+  data_param->set_scale(scale);
+  data_param->set_source(this->filename_->c_str());
+  data_param->set_backend(DataParameter_DB_LMDB);
+  DataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 2);
+  EXPECT_EQ(this->blob_top_data_->height(), 3);
+  EXPECT_EQ(this->blob_top_data_->width(), 4);
+  EXPECT_EQ(this->blob_top_label_->num(), 5);
+  EXPECT_EQ(this->blob_top_label_->channels(), 1);
+  EXPECT_EQ(this->blob_top_label_->height(), 1);
+  EXPECT_EQ(this->blob_top_label_->width(), 1);
+
+  for (int iter = 0; iter < 100; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    for (int i = 0; i < 5; ++i) {
+      for (int j = 0; j < 24; ++j) {
+        EXPECT_EQ(scale * i, this->blob_top_data_->cpu_data()[i * 24 + j])
+            << "debug: iter " << iter << " i " << i << " j " << j;
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataLayerTest, TestReadLMDBGPU) {
+  Caffe::set_mode(Caffe::GPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const TypeParam scale = 3;
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(5);
+  data_param->set_scale(scale);
+  data_param->set_source(this->filename_->c_str());
+  data_param->set_backend(DataParameter_DB_LMDB);
+  DataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 2);
+  EXPECT_EQ(this->blob_top_data_->height(), 3);
+  EXPECT_EQ(this->blob_top_data_->width(), 4);
+  EXPECT_EQ(this->blob_top_label_->num(), 5);
+  EXPECT_EQ(this->blob_top_label_->channels(), 1);
+  EXPECT_EQ(this->blob_top_label_->height(), 1);
+  EXPECT_EQ(this->blob_top_label_->width(), 1);
+
+  for (int iter = 0; iter < 100; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    for (int i = 0; i < 5; ++i) {
+      for (int j = 0; j < 24; ++j) {
+        EXPECT_EQ(scale * i, this->blob_top_data_->cpu_data()[i * 24 + j])
+            << "debug: iter " << iter << " i " << i << " j " << j;
+      }
+    }
+  }
+}
+#endif  // USE_LMDB
+
+// Test that records come out in order, wrapping around the leveldb, whatever
+// the number of batches kept in the prefetch ring.
+TYPED_TEST(DataLayerTest, TestReadPrefetchDepthCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  const int batch_size = 3;
+  for (int depth = 1; depth <= 4; ++depth) {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_prefetch_depth(depth);
+    data_param->set_source(this->filename_->c_str());
+    DataLayer<TypeParam> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_data_->num(), batch_size);
+    EXPECT_EQ(this->blob_top_label_->num(), batch_size);
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int record = (iter * batch_size + i) % 5;
+        EXPECT_EQ(record, this->blob_top_label_->cpu_data()[i])
+            << "debug: depth " << depth << " iter " << iter << " i " << i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(record, this->blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+      }
+    }
+  }
+}
+
+// Batches and read-ahead windows of different sizes, so that batches span
+// windows and windows end at the epoch.
+TYPED_TEST(DataLayerTest, TestReadShuffleCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_random_seed(this->seed_);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(2);
+  data_param->set_shuffle(true);
+  data_param->set_shuffle_readahead(3);
+  data_param->set_source(this->filename_->c_str());
+  const int num_epochs = 20;
+  vector<int> labels = this->ReadShuffledEpochs(param, num_epochs);
+  // The chance of every epoch coming out in key order is 120^-20.
+  int num_in_order = 0;
+  for (int epoch = 0; epoch < num_epochs; ++epoch) {
+    bool in_order = true;
+    for (int i = 0; i < 5; ++i) {
+      in_order &= labels[epoch * 5 + i] == i;
+    }
+    num_in_order += in_order;
+  }
+  EXPECT_LT(num_in_order, num_epochs);
+}
+
+#ifdef USE_LMDB
+TYPED_TEST(DataLayerTest, TestReadShuffleKeyIndexLMDBCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const string index_file = *this->filename_ + ".keys";
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(5);
+  data_param->set_shuffle(true);
+  data_param->set_key_index_file(index_file);
+  data_param->set_backend(DataParameter_DB_LMDB);
+  data_param->set_source(this->filename_->c_str());
+  // The first layer writes the index, and the second reads it.
+  Caffe::set_random_seed(this->seed_);
+  vector<int> written = this->ReadShuffledEpochs(param, 3);
+  std::ifstream infile(index_file.c_str());
+  string key;
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(std::getline(infile, key).good());
+    stringstream ss;
+    ss << i;
+    EXPECT_EQ(ss.str(), key);
+  }
+  EXPECT_FALSE(std::getline(infile, key).good());
+  infile.close();
+  Caffe::set_random_seed(this->seed_);
+  vector<int> read = this->ReadShuffledEpochs(param, 3);
+  EXPECT_TRUE(written == read);
+  remove(index_file.c_str());
+}
+#endif  // USE_LMDB
+
+// Shard 0 of 2 holds records 0 and 1, and shard 1 records 2 to 4.
+TYPED_TEST(DataLayerTest, TestReadShardsCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  const int batch_size = 4;
+  const int shard_begin[2] = { 0, 2 };
+  const int shard_size[2] = { 2, 3 };
+  for (int shard_id = 0; shard_id < 2; ++shard_id) {
+    for (int shuffle = 0; shuffle < 2; ++shuffle) {
+      LayerParameter param;
+      DataParameter* data_param = param.mutable_data_param();
+      data_param->set_batch_size(batch_size);
+      data_param->set_shard_id(shard_id);
+      data_param->set_num_shards(2);
+      data_param->set_shuffle(shuffle);
+      data_param->set_source(this->filename_->c_str());
+      DataLayer<TypeParam> layer(param);
+      layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+      vector<int> counts(5, 0);
+      for (int iter = 0; iter < shard_size[shard_id] * 3; ++iter) {
+        layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+        for (int i = 0; i < batch_size; ++i) {
+          const int label = this->blob_top_label_->cpu_data()[i];
+          if (!shuffle) {
+            const int record = shard_begin[shard_id]
+                + (iter * batch_size + i) % shard_size[shard_id];
+            EXPECT_EQ(record, label) << "debug: shard " << shard_id
+                << " iter " << iter << " i " << i;
+          }
+          ++counts[label];
+        }
+      }
+      // Whole epochs were read, so every record of the shard was read as
+      // often as the others.
+      for (int record = 0; record < 5; ++record) {
+        const bool in_shard = record >= shard_begin[shard_id] &&
+            record < shard_begin[shard_id] + shard_size[shard_id];
+        EXPECT_EQ(in_shard ? batch_size * 3 : 0, counts[record])
+            << "debug: shard " << shard_id << " shuffle " << shuffle
+            << " record " << record;
+      }
+    }
+  }
+}
+
+// A layer seeked to another's cursor reads the records the other would read
+// next: in key order, or for the rest of the shuffled epoch.
+TYPED_TEST(DataLayerTest, TestSeekDataCursorCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  const int batch_size = 3;
+  for (int shuffle = 0; shuffle < 2; ++shuffle) {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_shuffle(shuffle);
+    data_param->set_source(this->filename_->c_str());
+    DataLayer<TypeParam> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    // 6 records read: the first epoch and one record of the second.
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    }
+    DataCursor cursor;
+    EXPECT_TRUE(layer.GetDataCursor(&cursor));
+    EXPECT_EQ(shuffle != 0, cursor.has_shuffle_seed());
+    vector<int> expected;
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        expected.push_back(this->blob_top_label_->cpu_data()[i]);
+      }
+    }
+    DataLayer<TypeParam> resumed(param);
+    resumed.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    resumed.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    resumed.SeekDataCursor(cursor);
+    vector<int> actual;
+    for (int iter = 0; iter < 2; ++iter) {
+      resumed.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        actual.push_back(this->blob_top_label_->cpu_data()[i]);
+      }
+    }
+    // Later epochs are shuffled by each layer's own rng.
+    const int num_same = shuffle ? 4 : 2 * batch_size;
+    for (int i = 0; i < num_same; ++i) {
+      EXPECT_EQ(expected[i], actual[i])
+          << "debug: shuffle " << shuffle << " i " << i;
+    }
+    if (!shuffle) {
+      EXPECT_EQ(1, expected[0]);
+    }
+  }
+}
+
+// Encoded records are decoded and resized by the layer, as ReadImageToDatum
+// would have done before storing them.
+TYPED_TEST(DataLayerTest, TestReadEncodedCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  const string image_file = "examples/images/cat.jpg";
+  {
+    shared_ptr<db::DB> db(db::GetDB(DataParameter_DB_LEVELDB));
+    db->Open(*this->filename_, db::NEW);
+    shared_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      ASSERT_TRUE(ReadFileToDatum(image_file, i, &datum));
+      EXPECT_TRUE(datum.encoded());
+      stringstream ss;
+      ss << i;
+      txn->Put(ss.str(), datum.SerializeAsString());
+    }
+    txn->Commit();
+  }
+  Datum expected;
+  ASSERT_TRUE(ReadImageToDatum(image_file, 0, 24, 32, &expected));
+  const string& expected_data = expected.data();
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(5);
+  data_param->set_new_height(24);
+  data_param->set_new_width(32);
+  data_param->set_num_workers(2);
+  data_param->set_source(this->filename_->c_str());
+  DataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 24);
+  EXPECT_EQ(this->blob_top_data_->width(), 32);
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+      for (int j = 0; j < expected_data.size(); ++j) {
+        EXPECT_EQ(static_cast<uint8_t>(expected_data[j]),
+            this->blob_top_data_->cpu_data()[i * expected_data.size() + j]);
+      }
+    }
+  }
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainCPU) {
   Caffe::set_phase(Caffe::TRAIN);
   Caffe::set_mode(Caffe::CPU);
@@ -286,6 +629,60 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededCPU) {
   }
 }
 
+// Test that splitting the batch across workers does not change the random
+// crops produced for a given seed.
+TYPED_TEST(DataLayerTest, TestReadCropTrainNumWorkersCPU) {
+  Caffe::set_phase(Caffe::TRAIN);
+  Caffe::set_mode(Caffe::CPU);
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->FillLevelDB(unique_pixels);
+  LayerParameter param;
+  DataParameter* data_param = param.mutable_data_param();
+  data_param->set_batch_size(5);
+  data_param->set_crop_size(1);
+  data_param->set_mirror(true);
+  data_param->set_source(this->filename_->c_str());
+
+  // Get crop sequence with a single worker.
+  Caffe::set_random_seed(this->seed_);
+  vector<vector<TypeParam> > crop_sequence;
+  {
+    DataLayer<TypeParam> layer1(param);
+    layer1.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer1.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      vector<TypeParam> iter_crop_sequence;
+      for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 2; ++j) {
+          iter_crop_sequence.push_back(
+              this->blob_top_data_->cpu_data()[i * 2 + j]);
+        }
+      }
+      crop_sequence.push_back(iter_crop_sequence);
+    }
+  }  // destroy 1st data layer and unlock the leveldb
+
+  // Get crop sequence with three workers from the same seed.
+  // Check that the sequence is the same as the original.
+  Caffe::set_random_seed(this->seed_);
+  data_param->set_num_workers(3);
+  DataLayer<TypeParam> layer2(param);
+  layer2.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  for (int iter = 0; iter < 2; ++iter) {
+    layer2.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    for (int i = 0; i < 5; ++i) {
+      for (int j = 0; j < 2; ++j) {
+        EXPECT_EQ(crop_sequence[iter][i * 2 + j],
+                  this->blob_top_data_->cpu_data()[i * 2 + j])
+            << "debug: iter " << iter << " i " << i << " j " << j;
+      }
+    }
+  }
+}
+
 // Test that the sequence of random crops is consistent when using
 // Caffe::set_random_seed.
 TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededGPU) {
@@ -0,0 +1,148 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/data_transform.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::vector;
+
+namespace caffe {
+
+template <typename Dtype>
+class DataTransformTest : public ::testing::Test {
+ protected:
+  // Odd sizes so that every crop row ends in a scalar tail.
+  DataTransformTest()
+      : channels_(3), height_(41), width_(37), scale_(0.5),
+        mean_(new Blob<Dtype>(1, 3, 41, 37)) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_min(0);
+    filler_param.set_max(255);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(mean_.get());
+    const int count = mean_->count();
+    uint8_data_.resize(count);
+    float_data_.resize(count);
+    for (int i = 0; i < count; ++i) {
+      uint8_data_[i] = static_cast<uint8_t>((i * 7919) % 256);
+      float_data_[i] = static_cast<float>((i * 7919) % 1000) / 3;
+    }
+  }
+
+  // The loop the data layers used before the shared transform.
+  template <typename SrcType>
+  void ReferenceCrop(const int h_off, const int w_off, const int crop_size,
+      const bool mirror, const SrcType* data, Dtype* top_data) {
+    const Dtype* mean = mean_->cpu_data();
+    for (int c = 0; c < channels_; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        for (int w = 0; w < crop_size; ++w) {
+          int top_index = (c * crop_size + h) * crop_size
+              + (mirror ? crop_size - 1 - w : w);
+          int data_index = (c * height_ + h + h_off) * width_ + w + w_off;
+          Dtype datum_element = static_cast<Dtype>(data[data_index]);
+          top_data[top_index] = (datum_element - mean[data_index]) * scale_;
+        }
+      }
+    }
+  }
+
+  template <typename SrcType>
+  void CheckCrop(const int crop_size, const bool mirror,
+      const SrcType* data) {
+    const int crop_count = channels_ * crop_size * crop_size;
+    vector<Dtype> expected(crop_count), actual(crop_count);
+    const int h_offs[2] = { 0, height_ - crop_size };
+    const int w_offs[2] = { 3, width_ - crop_size };
+    for (int i = 0; i < 2; ++i) {
+      ReferenceCrop(h_offs[i], w_offs[i], crop_size, mirror, data,
+          &expected[0]);
+      caffe_transform_crop(channels_, height_, width_, h_offs[i], w_offs[i],
+          crop_size, crop_size, mirror, data, mean_->cpu_data(), scale_,
+          &actual[0]);
+      for (int j = 0; j < crop_count; ++j) {
+        EXPECT_NEAR(expected[j], actual[j], 1e-4)
+            << "crop " << crop_size << " mirror " << mirror << " j " << j;
+      }
+    }
+  }
+
+  template <typename SrcType>
+  void CheckFull(const SrcType* data) {
+    const int count = mean_->count();
+    const Dtype* mean = mean_->cpu_data();
+    vector<Dtype> actual(count);
+    caffe_transform(count, data, mean, scale_, &actual[0]);
+    for (int j = 0; j < count; ++j) {
+      EXPECT_NEAR((static_cast<Dtype>(data[j]) - mean[j]) * scale_,
+          actual[j], 1e-4);
+    }
+  }
+
+  const int channels_;
+  const int height_;
+  const int width_;
+  const Dtype scale_;
+  shared_ptr<Blob<Dtype> > mean_;
+  vector<uint8_t> uint8_data_;
+  vector<float> float_data_;
+};
+
+typedef ::testing::Types<float, double> Dtypes;
+TYPED_TEST_CASE(DataTransformTest, Dtypes);
+
+TYPED_TEST(DataTransformTest, TestFullUint8) {
+  this->CheckFull(&this->uint8_data_[0]);
+}
+
+TYPED_TEST(DataTransformTest, TestFullFloat) {
+  this->CheckFull(&this->float_data_[0]);
+}
+
+TYPED_TEST(DataTransformTest, TestCropUint8) {
+  for (int crop_size = 1; crop_size < 37; crop_size += 4) {
+    this->CheckCrop(crop_size, false, &this->uint8_data_[0]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestCropMirrorUint8) {
+  for (int crop_size = 1; crop_size < 37; crop_size += 4) {
+    this->CheckCrop(crop_size, true, &this->uint8_data_[0]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestCropFloat) {
+  for (int crop_size = 1; crop_size < 37; crop_size += 4) {
+    this->CheckCrop(crop_size, false, &this->float_data_[0]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestCropMirrorFloat) {
+  for (int crop_size = 1; crop_size < 37; crop_size += 4) {
+    this->CheckCrop(crop_size, true, &this->float_data_[0]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestStridedRow) {
+  // Every third value, as in an interleaved 3-channel image row.
+  const int n = 10;
+  const TypeParam* mean = this->mean_->cpu_data();
+  vector<TypeParam> actual(n);
+  caffe_transform_row(n, &this->uint8_data_[1], 3, mean, this->scale_, false,
+      &actual[0]);
+  for (int j = 0; j < n; ++j) {
+    EXPECT_NEAR(
+        (static_cast<TypeParam>(this->uint8_data_[1 + 3 * j]) - mean[j])
+            * this->scale_, actual[j], 1e-4);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,45 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::string;
+
+namespace caffe {
+namespace db {
+
+class DBTest : public ::testing::Test {};
+
+TEST_F(DBTest, TestInterpolateKeyDigits) {
+  EXPECT_EQ(InterpolateKey("00000000_a", "00000100_z", 0.), "00000000");
+  EXPECT_EQ(InterpolateKey("00000000_a", "00000100_z", 0.5), "00000050");
+  EXPECT_EQ(InterpolateKey("00000000_a", "00000100_z", 1.), "00000100");
+}
+
+TEST_F(DBTest, TestInterpolateKeyBounds) {
+  // Keys shorter than the interpolated bytes stay within first and last,
+  // so that seeking to them finds the first and the last record.
+  const char* ends[][2] = {{"0", "9999"}, {"apple", "zed"}, {"a", "b"}};
+  const int num_ends = sizeof(ends) / sizeof(ends[0]);
+  for (int i = 0; i < num_ends; ++i) {
+    const string first = ends[i][0];
+    const string last = ends[i][1];
+    EXPECT_EQ(InterpolateKey(first, last, 0.), first);
+    EXPECT_EQ(InterpolateKey(first, last, 1.), last);
+    for (double fraction = 0; fraction <= 1; fraction += 0.125) {
+      const string key = InterpolateKey(first, last, fraction);
+      EXPECT_GE(key, first);
+      EXPECT_LE(key, last);
+    }
+  }
+  // Past six bytes, last is cut short, to a key just before it.
+  EXPECT_EQ(InterpolateKey("key0", "key1234567", 1.), "key123456");
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,66 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/feature_matrix.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FeatureMatrixTest : public ::testing::Test {};
+
+TEST_F(FeatureMatrixTest, TestWriteRead) {
+  const string filename(tmpnam(NULL));
+  const int cols = 3;
+  std::vector<float> expected;
+  {
+    FeatureMatrixWriter writer(filename, cols);
+    for (int batch = 0; batch < 3; ++batch) {
+      std::vector<float> rows;
+      for (int i = 0; i < (batch + 1) * cols; ++i) {
+        rows.push_back(expected.size() + rows.size() + 0.5f);
+      }
+      writer.AppendRows(&rows[0], batch + 1);
+      expected.insert(expected.end(), rows.begin(), rows.end());
+    }
+    EXPECT_EQ(6, writer.rows());
+  }
+  uint64_t rows;
+  int read_cols;
+  std::vector<float> data;
+  ASSERT_TRUE(ReadFeatureMatrix(filename, &rows, &read_cols, &data));
+  EXPECT_EQ(6, rows);
+  EXPECT_EQ(cols, read_cols);
+  ASSERT_EQ(expected.size(), data.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], data[i]);
+  }
+  // The data starts right after the header, where a reader would map it.
+  FILE* file = fopen(filename.c_str(), "rb");
+  ASSERT_TRUE(file != NULL);
+  fseek(file, sizeof(FeatureMatrixHeader), SEEK_SET);
+  float first;
+  EXPECT_EQ(1, fread(&first, sizeof(first), 1, file));
+  EXPECT_EQ(expected[0], first);
+  fclose(file);
+  remove(filename.c_str());
+}
+
+TEST_F(FeatureMatrixTest, TestNotAMatrix) {
+  const string filename(tmpnam(NULL));
+  FILE* file = fopen(filename.c_str(), "wb");
+  fputs("not a matrix at all, not at all", file);
+  fclose(file);
+  uint64_t rows;
+  int cols;
+  std::vector<float> data;
+  EXPECT_FALSE(ReadFeatureMatrix(filename, &rows, &cols, &data));
+  remove(filename.c_str());
+}
+
+}  // namespace caffe
@@ -0,0 +1,93 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {};
+
+TEST_F(HostMemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(HostMemoryPool::SizeClass(0), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(64), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(65), 128);
+  EXPECT_EQ(HostMemoryPool::SizeClass(129), 192);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1024), 1024);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1025), 1280);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1 << 20), 1 << 20);
+  EXPECT_EQ(HostMemoryPool::SizeClass((1 << 20) + 1), (5 << 20) / 4);
+}
+
+TEST_F(HostMemoryPoolTest, TestReuse) {
+  HostMemoryPool pool;
+  pool.set_max_held_bytes(1 << 20);
+  void* first = pool.Allocate(1000);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % HostMemoryPool::kAlignment,
+            0);
+  EXPECT_EQ(pool.stats().bytes_in_use, 1024);
+  pool.Free(first, 1000);
+  EXPECT_EQ(pool.stats().bytes_in_use, 0);
+  EXPECT_EQ(pool.stats().bytes_held, 1024);
+  // A request of the same size class gets the held block back.
+  void* second = pool.Allocate(900);
+  EXPECT_EQ(second, first);
+  void* third = pool.Allocate(2000);
+  EXPECT_NE(third, first);
+  HostMemoryPool::Stats stats = pool.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.bytes_in_use, 1024 + 2048);
+  EXPECT_EQ(stats.bytes_held, 0);
+  pool.Free(second, 900);
+  pool.Free(third, 2000);
+  pool.Trim();
+  EXPECT_EQ(pool.stats().bytes_held, 0);
+}
+
+TEST_F(HostMemoryPoolTest, TestMaxHeldBytes) {
+  HostMemoryPool pool;
+  pool.set_max_held_bytes(1024);
+  void* first = pool.Allocate(1024);
+  void* second = pool.Allocate(1024);
+  pool.Free(first, 1024);
+  pool.Free(second, 1024);
+  EXPECT_EQ(pool.stats().bytes_held, 1024);
+  pool.set_max_held_bytes(0);
+  EXPECT_EQ(pool.stats().bytes_held, 0);
+}
+
+TEST_F(HostMemoryPoolTest, TestDefaultMaxHeldBytes) {
+  HostMemoryPool pool;
+  vector<void*> blocks;
+  for (int i = 0; i < 4; ++i) {
+    blocks.push_back(pool.Allocate(1024));
+  }
+  EXPECT_EQ(pool.stats().peak_bytes_in_use, 4096);
+  for (int i = 0; i < 4; ++i) {
+    pool.Free(blocks[i], 1024);
+  }
+  // A quarter of the peak is held; the rest goes back to the system.
+  EXPECT_EQ(pool.stats().bytes_held, 1024);
+  EXPECT_EQ(pool.stats().peak_bytes_in_use, 4096);
+  pool.Trim();
+  EXPECT_EQ(pool.stats().bytes_held, 0);
+}
+
+TEST_F(HostMemoryPoolTest, TestHugePages) {
+  HostMemoryPool pool;
+  pool.set_huge_pages(true);
+  const size_t size = 3 * HostMemoryPool::kHugePageSize;
+  char* data = reinterpret_cast<char*>(pool.Allocate(size));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % HostMemoryPool::kHugePageSize,
+            0);
+  data[0] = 1;
+  data[size - 1] = 1;
+  pool.Free(data, size);
+}
+
+}  // namespace caffe
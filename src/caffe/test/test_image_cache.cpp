@@ -0,0 +1,71 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::string;
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // An image of the given number of bytes, labeled with its key.
+  shared_ptr<const Datum> MakeImage(const int key, const int bytes) {
+    shared_ptr<Datum> image(new Datum());
+    image->set_label(key);
+    image->set_data(string(bytes, static_cast<char>(key)));
+    return image;
+  }
+};
+
+TEST_F(ImageCacheTest, TestHitAndMiss) {
+  ImageCache cache(100);
+  EXPECT_FALSE(cache.Get(3).get());
+  cache.Put(3, MakeImage(3, 10));
+  shared_ptr<const Datum> image = cache.Get(3);
+  ASSERT_TRUE(image.get());
+  EXPECT_EQ(3, image->label());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(10, cache.bytes());
+}
+
+TEST_F(ImageCacheTest, TestEvictsLeastRecentlyUsed) {
+  ImageCache cache(30);
+  cache.Put(0, MakeImage(0, 10));
+  cache.Put(1, MakeImage(1, 10));
+  cache.Put(2, MakeImage(2, 10));
+  // Using 0 leaves 1 as the least recently used.
+  EXPECT_TRUE(cache.Get(0).get());
+  cache.Put(3, MakeImage(3, 15));
+  EXPECT_EQ(2, cache.evictions());
+  EXPECT_TRUE(cache.Get(0).get());
+  EXPECT_FALSE(cache.Get(1).get());
+  EXPECT_FALSE(cache.Get(2).get());
+  EXPECT_TRUE(cache.Get(3).get());
+  EXPECT_EQ(25, cache.bytes());
+}
+
+TEST_F(ImageCacheTest, TestSkipsImagesOverBudget) {
+  ImageCache cache(30);
+  cache.Put(0, MakeImage(0, 10));
+  cache.Put(1, MakeImage(1, 31));
+  EXPECT_FALSE(cache.Get(1).get());
+  EXPECT_TRUE(cache.Get(0).get());
+  EXPECT_EQ(0, cache.evictions());
+}
+
+TEST_F(ImageCacheTest, TestPutKeepsExisting) {
+  ImageCache cache(100);
+  cache.Put(0, MakeImage(0, 10));
+  cache.Put(0, MakeImage(7, 20));
+  EXPECT_EQ(0, cache.Get(0)->label());
+  EXPECT_EQ(10, cache.bytes());
+}
+
+}  // namespace caffe
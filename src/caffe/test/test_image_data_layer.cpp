@@ -112,6 +112,28 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadShard) {
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(4);
+  image_data_param->set_source(this->filename_->c_str());
+  image_data_param->set_new_height(256);
+  image_data_param->set_new_width(256);
+  image_data_param->set_shard_id(1);
+  image_data_param->set_num_shards(2);
+  ImageDataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 4);
+  // Shard 1 of 2 holds every other line, starting from the second.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    EXPECT_EQ(1, this->blob_top_label_->cpu_data()[0]);
+    EXPECT_EQ(3, this->blob_top_label_->cpu_data()[1]);
+    EXPECT_EQ(1, this->blob_top_label_->cpu_data()[2]);
+    EXPECT_EQ(3, this->blob_top_label_->cpu_data()[3]);
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   LayerParameter param;
   ImageDataParameter* image_data_param = param.mutable_image_data_param();
@@ -145,4 +167,82 @@ TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   }
 }
 
+// A layer seeked to another's cursor reads the lines the other would read
+// next, for the rest of the shuffled epoch.
+TYPED_TEST(ImageDataLayerTest, TestSeekDataCursor) {
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(2);
+  image_data_param->set_source(this->filename_->c_str());
+  image_data_param->set_new_height(32);
+  image_data_param->set_new_width(32);
+  image_data_param->set_shuffle(true);
+  ImageDataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+  DataCursor cursor;
+  EXPECT_TRUE(layer.GetDataCursor(&cursor));
+  EXPECT_EQ(2, cursor.position());
+  vector<TypeParam> expected;
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    expected.push_back(this->blob_top_label_->cpu_data()[0]);
+    expected.push_back(this->blob_top_label_->cpu_data()[1]);
+  }
+  ImageDataLayer<TypeParam> resumed(param);
+  resumed.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  resumed.SeekDataCursor(cursor);
+  vector<TypeParam> actual;
+  for (int iter = 0; iter < 2; ++iter) {
+    resumed.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    actual.push_back(this->blob_top_label_->cpu_data()[0]);
+    actual.push_back(this->blob_top_label_->cpu_data()[1]);
+  }
+  // The 3 lines left of the epoch; the next epoch is shuffled by each
+  // layer's own rng.
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(expected[i], actual[i]) << "debug: i " << i;
+  }
+}
+
+// Later epochs served from the cache match those read from disk.
+TYPED_TEST(ImageDataLayerTest, TestCache) {
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(3);
+  image_data_param->set_source(this->filename_->c_str());
+  image_data_param->set_new_height(32);
+  image_data_param->set_new_width(32);
+  ImageDataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  vector<TypeParam> expected;
+  for (int iter = 0; iter < 4; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    expected.insert(expected.end(), this->blob_top_data_->cpu_data(),
+        this->blob_top_data_->cpu_data() + this->blob_top_data_->count());
+  }
+  image_data_param->set_cache_size_mb(1);
+  ImageDataLayer<TypeParam> cached(param);
+  cached.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  for (int iter = 0; iter < 4; ++iter) {
+    cached.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    const TypeParam* data = this->blob_top_data_->cpu_data();
+    const int count = this->blob_top_data_->count();
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(expected[iter * count + i], data[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ((iter * 3 + i) % 5, this->blob_top_label_->cpu_data()[i]);
+    }
+  }
+  // The second epoch is read from the cache, which holds all five images
+  // within its budget.
+  const ImageCache* cache = cached.cache();
+  ASSERT_TRUE(cache);
+  EXPECT_GT(cache->hits(), 0);
+  EXPECT_EQ(5, cache->size());
+  EXPECT_LE(cache->bytes(), cache->max_bytes());
+  EXPECT_LE(cache->bytes(), 1 << 20);
+}
+
 }  // namespace caffe
@@ -0,0 +1,103 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "opencvlib.h"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::string;
+
+namespace caffe {
+
+class IOTest : public ::testing::Test {
+ protected:
+  IOTest() : filename_("examples/images/cat.jpg") {}
+
+  // The full-size decode and resize ReadImageToDatum used to do.
+  void ReadReference(const int height, const int width, Datum* datum) {
+    IplImage* cv_img_origin = cvLoadImage(filename_.c_str(), -1);
+    ASSERT_TRUE(cv_img_origin != NULL);
+    IplImage* cv_img = cvCreateImage(cvSize(width, height),
+        cv_img_origin->depth, cv_img_origin->nChannels);
+    cvResize(cv_img_origin, cv_img);
+    const int channels = cv_img->nChannels;
+    datum->set_channels(channels);
+    datum->set_height(height);
+    datum->set_width(width);
+    string* data = datum->mutable_data();
+    data->resize(channels * height * width);
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          (*data)[(c * height + h) * width + w] =
+              cv_img->imageData[h * cv_img->widthStep + w * channels + c];
+        }
+      }
+    }
+    cvReleaseImage(&cv_img_origin);
+    cvReleaseImage(&cv_img);
+  }
+
+  const string filename_;
+};
+
+TEST_F(IOTest, TestReadImageToDatum) {
+  Datum datum;
+  ASSERT_TRUE(ReadImageToDatum(filename_, 7, 0, 0, &datum));
+  EXPECT_EQ(7, datum.label());
+  EXPECT_EQ(3, datum.channels());
+  EXPECT_EQ(1200, datum.height());
+  EXPECT_EQ(1600, datum.width());
+  EXPECT_EQ(3 * 1200 * 1600, datum.data().size());
+  EXPECT_FALSE(datum.encoded());
+}
+
+TEST_F(IOTest, TestReadImageToDatumMissing) {
+  Datum datum;
+  EXPECT_FALSE(ReadImageToDatum("no/such/image.jpg", 0, 32, 32, &datum));
+}
+
+// With USE_LIBJPEG, resizing decodes the JPEG at a reduced scale, so the
+// pixels are close to, but not exactly, those of a full decode and resize.
+TEST_F(IOTest, TestReadImageToDatumResize) {
+  const int height = 120;
+  const int width = 100;
+  Datum datum, reference;
+  ASSERT_TRUE(ReadImageToDatum(filename_, 0, height, width, &datum));
+  ReadReference(height, width, &reference);
+  EXPECT_EQ(3, datum.channels());
+  EXPECT_EQ(height, datum.height());
+  EXPECT_EQ(width, datum.width());
+  ASSERT_EQ(reference.data().size(), datum.data().size());
+  double total_diff = 0;
+  for (int i = 0; i < datum.data().size(); ++i) {
+    total_diff += abs(static_cast<int>(
+        static_cast<uint8_t>(datum.data()[i])) -
+        static_cast<int>(static_cast<uint8_t>(reference.data()[i])));
+  }
+  EXPECT_LT(total_diff / datum.data().size(), 8);
+}
+
+TEST_F(IOTest, TestDecodeDatum) {
+  Datum encoded, decoded;
+  ASSERT_TRUE(ReadFileToDatum(filename_, 3, &encoded));
+  EXPECT_TRUE(encoded.encoded());
+  EXPECT_EQ(3, encoded.label());
+  ASSERT_TRUE(ReadImageToDatum(filename_, 3, 60, 80, &decoded));
+  ASSERT_TRUE(DecodeDatum(60, 80, &encoded));
+  EXPECT_FALSE(encoded.encoded());
+  EXPECT_EQ(3, encoded.label());
+  EXPECT_EQ(decoded.channels(), encoded.channels());
+  EXPECT_EQ(decoded.height(), encoded.height());
+  EXPECT_EQ(decoded.width(), encoded.width());
+  EXPECT_TRUE(decoded.data() == encoded.data());
+}
+
+}  // namespace caffe
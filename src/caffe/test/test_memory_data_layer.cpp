@@ -1,8 +1,13 @@
 // Copyright 2014 BVLC and contributors.
 
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
+#include "gtest/gtest.h"
 #include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/vision_layers.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -105,4 +110,141 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+// Several producers push every sample once; each batch is full and every
+// sample comes out with its own label.
+TYPED_TEST(MemoryDataLayerTest, TestPush) {
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  shared_ptr<MemoryDataLayer<TypeParam> > layer(
+      new MemoryDataLayer<TypeParam>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const int num = this->data_->num();
+  const int num_producers = 3;
+  const int datum_size = this->data_->offset(1);
+  const TypeParam* data = this->data_->cpu_data();
+  vector<std::thread> producers;
+  for (int p = 0; p < num_producers; ++p) {
+    producers.push_back(std::thread([&layer, data, datum_size, num, p]() {
+      for (int i = p; i < num; i += num_producers) {
+        layer->Push(data + i * datum_size, TypeParam(i));
+      }
+    }));
+  }
+  vector<int> seen(num, 0);
+  for (int b = 0; b < this->batches_; ++b) {
+    layer->Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    EXPECT_EQ(this->batch_size_, layer->last_batch_size());
+    for (int j = 0; j < this->batch_size_; ++j) {
+      const int i = static_cast<int>(this->label_blob_->cpu_data()[j]);
+      ASSERT_GE(i, 0);
+      ASSERT_LT(i, num);
+      ++seen[i];
+      for (int k = 0; k < datum_size; ++k) {
+        EXPECT_EQ(data[i * datum_size + k],
+            this->data_blob_->cpu_data()[j * datum_size + k]);
+      }
+    }
+  }
+  for (int p = 0; p < num_producers; ++p) {
+    producers[p].join();
+  }
+  for (int i = 0; i < num; ++i) {
+    EXPECT_EQ(1, seen[i]) << "debug: i " << i;
+  }
+}
+
+// Producers block once queue_size samples are waiting.
+TYPED_TEST(MemoryDataLayerTest, TestBackpressure) {
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_size(this->batch_size_);
+  shared_ptr<MemoryDataLayer<TypeParam> > layer(
+      new MemoryDataLayer<TypeParam>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const int datum_size = this->data_->offset(1);
+  const TypeParam* data = this->data_->cpu_data();
+  const int num = 3 * this->batch_size_;
+  std::atomic<int> pushed(0);
+  std::thread producer([&layer, &pushed, data, datum_size, num]() {
+    for (int i = 0; i < num; ++i) {
+      layer->Push(data + i * datum_size, TypeParam(i));
+      ++pushed;
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(this->batch_size_, pushed.load());
+  for (int b = 0; b < 3; ++b) {
+    layer->Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    for (int j = 0; j < this->batch_size_; ++j) {
+      EXPECT_EQ(b * this->batch_size_ + j,
+          this->label_blob_->cpu_data()[j]);
+    }
+  }
+  producer.join();
+  EXPECT_EQ(num, pushed.load());
+}
+
+// With a timeout, Forward returns the samples it has and zero fills the
+// rest of the batch.
+TYPED_TEST(MemoryDataLayerTest, TestPartialBatch) {
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_timeout_ms(10);
+  shared_ptr<MemoryDataLayer<TypeParam> > layer(
+      new MemoryDataLayer<TypeParam>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const int datum_size = this->data_->offset(1);
+  const TypeParam* data = this->data_->cpu_data();
+  const int partial = 3;
+  for (int i = 0; i < partial; ++i) {
+    layer->Push(data + i * datum_size, TypeParam(i + 1));
+  }
+  layer->Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_EQ(partial, layer->last_batch_size());
+  EXPECT_EQ(this->batch_size_, this->data_blob_->num());
+  for (int j = 0; j < this->batch_size_; ++j) {
+    EXPECT_EQ(j < partial ? j + 1 : 0, this->label_blob_->cpu_data()[j]);
+  }
+  for (int k = 0; k < this->data_blob_->count(); ++k) {
+    EXPECT_EQ(k < partial * datum_size ? data[k] : 0,
+        this->data_blob_->cpu_data()[k]);
+  }
+}
+
+// The timeout runs from the push of the oldest sample, so samples that have
+// already waited that long are emitted without waiting again.
+TYPED_TEST(MemoryDataLayerTest, TestTimeoutFromPush) {
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  const int timeout_ms = 500;
+  md_param->set_timeout_ms(timeout_ms);
+  shared_ptr<MemoryDataLayer<TypeParam> > layer(
+      new MemoryDataLayer<TypeParam>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const TypeParam* data = this->data_->cpu_data();
+  layer->Push(data, TypeParam(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+  const int64_t start_us = MonotonicMicros();
+  layer->Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_LT(MonotonicMicros() - start_us, timeout_ms / 2 * 1000);
+  EXPECT_EQ(1, layer->last_batch_size());
+  EXPECT_EQ(1, this->label_blob_->cpu_data()[0]);
+}
+
 }  // namespace caffe
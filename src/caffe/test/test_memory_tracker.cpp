@@ -0,0 +1,110 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <google/protobuf/text_format.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/memory_tracker.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class MemoryTrackerTest : public ::testing::Test {};
+
+TEST_F(MemoryTrackerTest, TestAllocateFree) {
+  MemoryTracker tracker;
+  const int conv = tracker.Register("conv1", MemoryTracker::WORKSPACE);
+  const int data = tracker.Register("data", MemoryTracker::DATA);
+  EXPECT_EQ(tracker.Register("conv1", MemoryTracker::WORKSPACE), conv);
+  EXPECT_NE(tracker.Register("conv1", MemoryTracker::PARAM), conv);
+  tracker.Allocate(conv, 100);
+  tracker.Allocate(data, 50);
+  tracker.Free(conv, 100);
+  tracker.Allocate(conv, 20);
+  EXPECT_EQ(tracker.current_bytes(), 70);
+  EXPECT_EQ(tracker.peak_bytes(), 150);
+  EXPECT_EQ(tracker.current_bytes(MemoryTracker::WORKSPACE), 20);
+  EXPECT_EQ(tracker.current_bytes(MemoryTracker::DATA), 50);
+  const vector<MemoryTracker::Entry> entries = tracker.entries();
+  ASSERT_EQ(entries.size(), 3);
+  EXPECT_EQ(entries[conv].owner, "conv1");
+  EXPECT_EQ(entries[conv].current_bytes, 20);
+  EXPECT_EQ(entries[conv].peak_bytes, 100);
+}
+
+TEST_F(MemoryTrackerTest, TestBlob) {
+  shared_ptr<MemoryTracker> tracker(new MemoryTracker());
+  {
+    Blob<float> blob(2, 3, 4, 5);
+    blob.mutable_cpu_data();
+    blob.TrackMemory(tracker, "blob", MemoryTracker::DATA,
+        MemoryTracker::DIFF);
+    // Memory allocated before tracking is counted too.
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::DATA),
+              120 * sizeof(float));
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::DIFF), 0);
+    blob.mutable_cpu_diff();
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::DIFF),
+              120 * sizeof(float));
+    // Shrinking keeps the memory; growing frees it and tracks the new.
+    blob.Reshape(1, 1, 1, 10);
+    EXPECT_EQ(tracker->current_bytes(), 240 * sizeof(float));
+    blob.Reshape(2, 3, 4, 6);
+    EXPECT_EQ(tracker->current_bytes(), 0);
+    blob.mutable_cpu_data();
+    EXPECT_EQ(tracker->current_bytes(), 144 * sizeof(float));
+    EXPECT_EQ(tracker->peak_bytes(), 240 * sizeof(float));
+  }
+  EXPECT_EQ(tracker->current_bytes(), 0);
+}
+
+TEST_F(MemoryTrackerTest, TestNet) {
+  Caffe::set_mode(Caffe::CPU);
+  const string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_dim: 2 "
+      "input_dim: 3 "
+      "input_dim: 4 "
+      "input_dim: 5 "
+      "force_backward: true "
+      "layers: { "
+      "  name: 'innerproduct' "
+      "  type: INNER_PRODUCT "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  shared_ptr<MemoryTracker> tracker;
+  {
+    Net<float> net(param);
+    tracker = net.memory_tracker();
+    net.ForwardPrefilled();
+    net.Backward();
+    const size_t blob_bytes = (2 * 60 + 2 * 10) * sizeof(float);
+    const size_t param_bytes = (10 * 60 + 10) * sizeof(float);
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::DATA), blob_bytes);
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::DIFF), blob_bytes);
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::PARAM), 2 * param_bytes);
+    // The bias multiplier of the inner product layer.
+    EXPECT_EQ(tracker->current_bytes(MemoryTracker::WORKSPACE),
+              2 * sizeof(float));
+    EXPECT_EQ(tracker->current_bytes(),
+              2 * blob_bytes + 2 * param_bytes + 2 * sizeof(float));
+    EXPECT_EQ(tracker->peak_bytes(), tracker->current_bytes());
+    net.memory_tracker()->Log(net.name());
+  }
+  EXPECT_EQ(tracker->current_bytes(), 0);
+}
+
+}  // namespace caffe
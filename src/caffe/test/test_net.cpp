@@ -2,12 +2,16 @@
 
 #include <google/protobuf/text_format.h>
 #include <leveldb/db.h>
+#include <map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "caffe/common.hpp"
+#include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -133,4 +137,229 @@ TYPED_TEST(NetTest, TestGetLayerByName) {
   EXPECT_FALSE(net.layer_by_name("label"));
 }
 
+TYPED_TEST(NetTest, TestProfile) {
+  Caffe::set_mode(Caffe::CPU);
+  const string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_dim: 2 "
+      "input_dim: 3 "
+      "input_dim: 4 "
+      "input_dim: 5 "
+      "force_backward: true "
+      "layers: { "
+      "  name: 'innerproduct' "
+      "  type: INNER_PRODUCT "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} "
+      "layers: { "
+      "  name: 'relu' "
+      "  type: RELU "
+      "  bottom: 'innerproduct' "
+      "  top: 'innerproduct' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<TypeParam> net(param);
+  EXPECT_FALSE(net.profiling());
+  ASSERT_EQ(net.layer_profiles().size(), 2);
+  net.ForwardPrefilled();
+  EXPECT_EQ(net.layer_profiles()[0].forward.count, 0);
+
+  net.set_profiling(true);
+  for (int i = 0; i < 3; ++i) {
+    net.ForwardPrefilled();
+    net.Backward();
+  }
+  for (int i = 0; i < 2; ++i) {
+    const LayerProfile& profile = net.layer_profiles()[i];
+    EXPECT_EQ(profile.forward.count, 3);
+    EXPECT_EQ(profile.backward.count, 3);
+    EXPECT_GE(profile.forward.min_ms, 0);
+    EXPECT_LE(profile.forward.min_ms, profile.forward.max_ms);
+    EXPECT_LE(profile.forward.max_ms, profile.forward.total_ms);
+    EXPECT_EQ(profile.top_bytes, 3 * 2 * 10 * sizeof(TypeParam));
+  }
+  net.LogProfile();
+
+  net.ResetProfile();
+  EXPECT_EQ(net.layer_profiles()[0].forward.count, 0);
+  EXPECT_EQ(net.layer_profiles()[0].top_bytes, 0);
+  net.set_profiling(false);
+  net.ForwardPrefilled();
+  EXPECT_EQ(net.layer_profiles()[0].forward.count, 0);
+}
+
+TYPED_TEST(NetTest, TestShareActivations) {
+  Caffe::set_mode(Caffe::CPU);
+  string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_dim: 2 "
+      "input_dim: 3 "
+      "input_dim: 4 "
+      "input_dim: 5 ";
+  // relu1 feeds two layers through a split, and is used until the last one.
+  const char* layers[][4] = {
+      { "ip1", "INNER_PRODUCT", "data", "ip1" },
+      { "relu1", "RELU", "ip1", "relu1" },
+      { "ip2", "INNER_PRODUCT", "relu1", "ip2" },
+      { "relu2", "RELU", "ip2", "relu2" },
+      { "ip3", "INNER_PRODUCT", "relu2", "ip3" },
+      { "ipb", "INNER_PRODUCT", "relu1", "ipb" } };
+  for (int i = 0; i < 6; ++i) {
+    proto += string("layers: { name: '") + layers[i][0] + "' type: " +
+        layers[i][1] + " bottom: '" + layers[i][2] + "' top: '" +
+        layers[i][3] + "' ";
+    if (string(layers[i][1]) == "INNER_PRODUCT") {
+      proto += "inner_product_param { num_output: 10 "
+          "weight_filler { type: 'gaussian' } "
+          "bias_filler { type: 'gaussian' } } ";
+    }
+    proto += "} ";
+  }
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<TypeParam> expected_net(param);
+  param.set_share_activations(true);
+  Net<TypeParam> net(param);
+  net.ShareTrainedLayersWith(&expected_net);
+  // Looks blobs up without blob_by_name, which would stop them sharing.
+  map<string, shared_ptr<Blob<TypeParam> > > blobs;
+  for (int i = 0; i < net.blobs().size(); ++i) {
+    blobs[net.blob_names()[i]] = net.blobs()[i];
+  }
+  // ip1 is dead once relu1 has run, so ip2 can reuse its memory, but relu1
+  // is used until ipb.
+  EXPECT_EQ(blobs["ip1"]->data(), blobs["ip2"]->data());
+  EXPECT_NE(blobs["ip1"]->data(), blobs["relu1"]->data());
+  EXPECT_NE(blobs["ip2"]->data(), blobs["relu1"]->data());
+  EXPECT_NE(blobs["ip2"]->data(), blobs["relu2"]->data());
+  EXPECT_NE(blobs["relu2"]->data(), blobs["relu1"]->data());
+  EXPECT_NE(blobs["ip3"]->data(), blobs["ipb"]->data());
+
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(expected_net.input_blobs()[0]);
+  caffe_copy(expected_net.input_blobs()[0]->count(),
+      expected_net.input_blobs()[0]->cpu_data(),
+      net.input_blobs()[0]->mutable_cpu_data());
+  // relu1 gets its own memory, so it still holds its data after Forward.
+  shared_ptr<Blob<TypeParam> > relu1 = net.blob_by_name("relu1");
+  const vector<Blob<TypeParam>*>& expected_outputs =
+      expected_net.ForwardPrefilled();
+  const vector<Blob<TypeParam>*>& outputs = net.ForwardPrefilled();
+  ASSERT_EQ(outputs.size(), 2);
+  for (int i = 0; i < outputs.size(); ++i) {
+    for (int j = 0; j < outputs[i]->count(); ++j) {
+      EXPECT_EQ(outputs[i]->cpu_data()[j], expected_outputs[i]->cpu_data()[j]);
+    }
+  }
+  const Blob<TypeParam>& expected_relu1 = *expected_net.blob_by_name("relu1");
+  for (int j = 0; j < relu1->count(); ++j) {
+    EXPECT_EQ(relu1->cpu_data()[j], expected_relu1.cpu_data()[j]);
+  }
+  // Blobs unshared after Forward keep the data it left them, and hold their
+  // own data from then on.
+  const char* names[] = { "ip2", "relu2" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<TypeParam>& blob = *net.blob_by_name(names[i]);
+    const Blob<TypeParam>& expected_blob = *expected_net.blob_by_name(names[i]);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], expected_blob.cpu_data()[j]);
+    }
+  }
+  EXPECT_NE(net.blob_by_name("ip2")->data(), blobs["ip1"]->data());
+  net.ForwardPrefilled();
+  for (int i = 0; i < 2; ++i) {
+    const Blob<TypeParam>& blob = *net.blob_by_name(names[i]);
+    const Blob<TypeParam>& expected_blob = *expected_net.blob_by_name(names[i]);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], expected_blob.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestInferenceOnly) {
+  Caffe::set_mode(Caffe::CPU);
+  const string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_dim: 2 "
+      "input_dim: 3 "
+      "input_dim: 4 "
+      "input_dim: 5 "
+      "inference_only: true "
+      "layers: { "
+      "  name: 'innerproduct' "
+      "  type: INNER_PRODUCT "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} "
+      "layers: { "
+      "  name: 'relu' "
+      "  type: RELU "
+      "  bottom: 'innerproduct' "
+      "  top: 'innerproduct' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<TypeParam> net(param);
+  EXPECT_TRUE(net.inference_only());
+  net.ForwardPrefilled();
+  for (int i = 0; i < net.blobs().size(); ++i) {
+    EXPECT_FALSE(net.blobs()[i]->diff_enabled());
+  }
+  for (int i = 0; i < net.params().size(); ++i) {
+    EXPECT_FALSE(net.params()[i]->diff_enabled());
+  }
+  EXPECT_EQ(net.memory_tracker()->current_bytes(MemoryTracker::DIFF), 0);
+  EXPECT_DEATH(net.Backward(), "inference-only");
+  NetParameter net_param;
+  EXPECT_DEATH(net.ToProto(&net_param, true), "diff of this blob is");
+}
+
+TYPED_TEST(NetTest, TestInferenceOnlyHingeLoss) {
+  Caffe::set_mode(Caffe::CPU);
+  const string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_dim: 2 "
+      "input_dim: 3 "
+      "input_dim: 1 "
+      "input_dim: 1 "
+      "input: 'label' "
+      "input_dim: 2 "
+      "input_dim: 1 "
+      "input_dim: 1 "
+      "input_dim: 1 "
+      "inference_only: true "
+      "layers: { "
+      "  name: 'loss' "
+      "  type: HINGE_LOSS "
+      "  bottom: 'data' "
+      "  bottom: 'label' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<TypeParam> net(param);
+  EXPECT_TRUE(net.inference_only());
+  caffe_set(net.input_blobs()[0]->count(), TypeParam(0),
+      net.input_blobs()[0]->mutable_cpu_data());
+  net.input_blobs()[1]->mutable_cpu_data()[0] = 0;
+  net.input_blobs()[1]->mutable_cpu_data()[1] = 2;
+  // The loss is computed without the diff of the data, which is disabled.
+  TypeParam loss;
+  net.ForwardPrefilled(&loss);
+  EXPECT_EQ(loss, 3);
+  EXPECT_FALSE(net.input_blobs()[0]->diff_enabled());
+}
+
 }  // namespace caffe
@@ -0,0 +1,137 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdio.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/util/trace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TraceTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Tracer::Disable();
+    Tracer::Clear();
+    filename_ = tmpnam(NULL);
+  }
+  virtual void TearDown() {
+    Tracer::Disable();
+    Tracer::Clear();
+    remove(filename_.c_str());
+  }
+
+  string ReadTrace() {
+    EXPECT_TRUE(Tracer::WriteChromeTrace(filename_));
+    std::ifstream file(filename_.c_str());
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  string filename_;
+};
+
+TEST_F(TraceTest, TestDisabled) {
+  EXPECT_FALSE(Tracer::enabled());
+  {
+    TraceScope trace("conv1", "forward");
+  }
+  EXPECT_EQ(Tracer::num_events(), 0);
+}
+
+TEST_F(TraceTest, TestScope) {
+  Tracer::Enable();
+  {
+    TraceScope trace("conv1", "forward");
+  }
+  {
+    TraceScope trace("conv1", "backward");
+  }
+  EXPECT_EQ(Tracer::num_events(), 2);
+  const string trace = ReadTrace();
+  EXPECT_EQ(trace.find("{\"traceEvents\":["), 0);
+  EXPECT_NE(trace.find("\"name\":\"conv1\",\"cat\":\"forward\",\"ph\":\"X\""),
+            string::npos);
+  EXPECT_NE(trace.find("\"name\":\"conv1\",\"cat\":\"backward\""),
+            string::npos);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+}
+
+TEST_F(TraceTest, TestEscape) {
+  Tracer::Enable();
+  Tracer::Record("a\"b\\c", "test", 0, 1);
+  EXPECT_NE(ReadTrace().find("\"name\":\"a\\\"b\\\\c\""), string::npos);
+}
+
+TEST_F(TraceTest, TestThreads) {
+  Tracer::Enable();
+  const int kNumThreads = 4;
+  const int kNumSpans = 100;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::thread([]() {
+      TraceThread trace_thread;
+      for (int j = 0; j < kNumSpans; ++j) {
+        TraceScope trace("span", "test");
+      }
+    }));
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i].join();
+  }
+  // The spans outlive their threads.
+  EXPECT_EQ(Tracer::num_events(), kNumThreads * kNumSpans);
+}
+
+TEST_F(TraceTest, TestRingBuffer) {
+  const int buffer_size = Tracer::buffer_size();
+  Tracer::set_buffer_size(8);
+  Tracer::Enable();
+  // A new thread gets a buffer of the new size.
+  std::thread thread([]() {
+    TraceThread trace_thread;
+    for (int j = 0; j < 20; ++j) {
+      Tracer::Record(j < 12 ? "old" : "new", "test", j, j + 1);
+    }
+  });
+  thread.join();
+  Tracer::set_buffer_size(buffer_size);
+  EXPECT_EQ(Tracer::num_events(), 8);
+  const string trace = ReadTrace();
+  EXPECT_EQ(trace.find("\"old\""), string::npos);
+  // The kept spans are written oldest first.
+  EXPECT_LT(trace.find("\"ts\":12,"), trace.find("\"ts\":19,"));
+}
+
+TEST_F(TraceTest, TestThreadReuse) {
+  Tracer::Enable();
+  // Threads that run one after the other share a buffer, and so a tid, once
+  // each releases it.
+  for (int i = 0; i < 10; ++i) {
+    std::thread([]() {
+      TraceThread trace_thread;
+      TraceScope trace("span", "test");
+    }).join();
+  }
+  EXPECT_EQ(Tracer::num_events(), 10);
+  const string trace = ReadTrace();
+  const size_t tid = trace.find("\"tid\":");
+  ASSERT_NE(tid, string::npos);
+  const string first_tid = trace.substr(tid, trace.find(',', tid) + 1 - tid);
+  int count = 0;
+  for (size_t pos = trace.find(first_tid); pos != string::npos;
+       pos = trace.find(first_tid, pos + 1)) {
+    ++count;
+  }
+  EXPECT_EQ(count, 10);
+}
+
+}  // namespace caffe
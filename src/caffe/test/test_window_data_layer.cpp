@@ -0,0 +1,159 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/vision_layers.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::string;
+using std::vector;
+
+namespace caffe {
+
+template <typename Dtype>
+class WindowDataLayerTest : public ::testing::Test {
+ protected:
+  WindowDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()),
+        filename_(new string(tmpnam(NULL))),
+        seed_(1701) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // Two images with a few foreground and background windows each.
+    std::ofstream outfile(filename_->c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << *filename_;
+    for (int i = 0; i < 2; ++i) {
+      outfile << "# " << i << " examples/images/cat.jpg 3 1200 1600 4\n";
+      outfile << i + 1 << " 0.9 100 100 599 499\n";
+      outfile << i + 1 << " 0.7 " << 300 + i * 100 << " 200 1199 899\n";
+      outfile << "3 0.1 0 0 199 99\n";
+      outfile << "3 0.2 1000 700 1599 1199\n";
+    }
+    outfile.close();
+    WindowDataParameter* window_data_param =
+        param_.mutable_window_data_param();
+    window_data_param->set_source(*filename_);
+    window_data_param->set_batch_size(8);
+    window_data_param->set_crop_size(32);
+    window_data_param->set_context_pad(4);
+    window_data_param->set_mirror(true);
+    window_data_param->set_fg_fraction(0.5);
+  }
+
+  virtual ~WindowDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Reads num_batches from a layer set up with param, appending the data
+  // and labels to data and labels.
+  void ReadBatches(const LayerParameter& param, const int num_batches,
+      vector<Dtype>* data, vector<Dtype>* labels) {
+    Caffe::set_random_seed(seed_);
+    WindowDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    for (int iter = 0; iter < num_batches; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      data->insert(data->end(), blob_top_data_->cpu_data(),
+          blob_top_data_->cpu_data() + blob_top_data_->count());
+      labels->insert(labels->end(), blob_top_label_->cpu_data(),
+          blob_top_label_->cpu_data() + blob_top_label_->count());
+    }
+  }
+
+  // Checks that a layer set up with param reads the same batches as one set
+  // up with the fixture's param.
+  void CheckSameBatches(const LayerParameter& param) {
+    vector<Dtype> expected_data, expected_labels, data, labels;
+    ReadBatches(param_, 3, &expected_data, &expected_labels);
+    ReadBatches(param, 3, &data, &labels);
+    ASSERT_EQ(expected_data.size(), data.size());
+    for (int i = 0; i < data.size(); ++i) {
+      EXPECT_EQ(expected_data[i], data[i]);
+    }
+    ASSERT_EQ(expected_labels.size(), labels.size());
+    for (int i = 0; i < labels.size(); ++i) {
+      EXPECT_EQ(expected_labels[i], labels[i]);
+    }
+  }
+
+  int seed_;
+  LayerParameter param_;
+  shared_ptr<string> filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+typedef ::testing::Types<float, double> Dtypes;
+TYPED_TEST_CASE(WindowDataLayerTest, Dtypes);
+
+TYPED_TEST(WindowDataLayerTest, TestRead) {
+  vector<TypeParam> batch_data, labels;
+  this->ReadBatches(this->param_, 2, &batch_data, &labels);
+  EXPECT_EQ(this->blob_top_data_->num(), 8);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 32);
+  EXPECT_EQ(this->blob_top_data_->width(), 32);
+  int num_nonzero = 0;
+  for (int i = 0; i < batch_data.size(); ++i) {
+    num_nonzero += (batch_data[i] != 0);
+  }
+  EXPECT_GT(num_nonzero, batch_data.size() / 2);
+  // The first half of every batch is background.
+  for (int i = 0; i < labels.size(); ++i) {
+    if (i % 8 < 4) {
+      EXPECT_EQ(0, labels[i]);
+    } else {
+      EXPECT_TRUE(labels[i] == 1 || labels[i] == 2);
+    }
+  }
+}
+
+TYPED_TEST(WindowDataLayerTest, TestGroupByImage) {
+  LayerParameter param(this->param_);
+  param.mutable_window_data_param()->set_group_by_image(true);
+  param.mutable_window_data_param()->set_num_workers(2);
+  this->CheckSameBatches(param);
+}
+
+TYPED_TEST(WindowDataLayerTest, TestCache) {
+  LayerParameter param(this->param_);
+  param.mutable_window_data_param()->set_cache_size_mb(16);
+  this->CheckSameBatches(param);
+  param.mutable_window_data_param()->set_group_by_image(true);
+  this->CheckSameBatches(param);
+}
+
+TYPED_TEST(WindowDataLayerTest, TestCacheMirrorUncropped) {
+  // Windows of exactly crop_size with no context, so that warping them
+  // resizes to the same size, and mirrored windows must not flip the cached
+  // image they are read from.
+  std::ofstream outfile(this->filename_->c_str(), std::ofstream::out);
+  for (int i = 0; i < 2; ++i) {
+    outfile << "# " << i << " examples/images/cat.jpg 3 1200 1600 2\n";
+    outfile << i + 1 << " 0.9 100 100 131 131\n";
+    outfile << "3 0.1 10 20 41 51\n";
+  }
+  outfile.close();
+  this->param_.mutable_window_data_param()->set_context_pad(0);
+  LayerParameter param(this->param_);
+  param.mutable_window_data_param()->set_cache_size_mb(16);
+  // Three batches of eight read every window six times, so each cached
+  // image serves windows in several epochs after its first.
+  this->CheckSameBatches(param);
+  param.mutable_window_data_param()->set_group_by_image(true);
+  param.mutable_window_data_param()->set_num_workers(2);
+  this->CheckSameBatches(param);
+}
+
+}  // namespace caffe
@@ -0,0 +1,77 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "caffe/common.hpp"
+#include "caffe/util/worker_pool.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::vector;
+
+namespace caffe {
+
+class WorkerPoolTest : public ::testing::Test {
+ protected:
+  // Runs a batch of num_items on a pool of num_workers and records, for
+  // every item, how often it ran and the first number its rng produced.
+  void RunBatch(const int num_workers, const int num_items,
+      const unsigned int seed, vector<int>* counts,
+      vector<unsigned int>* draws) {
+    counts->assign(num_items, 0);
+    draws->assign(num_items, 0);
+    WorkerPool pool(num_workers);
+    EXPECT_EQ(num_workers, pool.num_workers());
+    pool.Run(num_items, seed, [counts, draws](int item_id, rng_t* rng) {
+      (*counts)[item_id]++;
+      (*draws)[item_id] = (*rng)();
+    });
+  }
+};
+
+TEST_F(WorkerPoolTest, TestRunsEveryItemOnce) {
+  vector<int> counts;
+  vector<unsigned int> draws;
+  for (int num_workers = 1; num_workers <= 4; ++num_workers) {
+    RunBatch(num_workers, 10, 1701, &counts, &draws);
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(1, counts[i]) << "num_workers " << num_workers << " i " << i;
+    }
+  }
+}
+
+TEST_F(WorkerPoolTest, TestMoreWorkersThanItems) {
+  vector<int> counts;
+  vector<unsigned int> draws;
+  RunBatch(8, 3, 1701, &counts, &draws);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(1, counts[i]);
+  }
+}
+
+TEST_F(WorkerPoolTest, TestDeterministicAcrossNumWorkers) {
+  vector<int> counts;
+  vector<unsigned int> expected_draws, draws;
+  RunBatch(1, 10, 1701, &counts, &expected_draws);
+  for (int num_workers = 2; num_workers <= 4; ++num_workers) {
+    RunBatch(num_workers, 10, 1701, &counts, &draws);
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(expected_draws[i], draws[i]);
+    }
+  }
+}
+
+TEST_F(WorkerPoolTest, TestReuse) {
+  WorkerPool pool(3);
+  vector<int> counts(7, 0);
+  for (int batch = 0; batch < 5; ++batch) {
+    pool.Run(7, batch, [&counts](int item_id, rng_t*) {
+      counts[item_id]++;
+    });
+  }
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(5, counts[i]);
+  }
+}
+
+}  // namespace caffe
@@ -1,6 +1,10 @@
 // Copyright 2014 BVLC and contributors.
 #include "caffe/common.hpp"
-#include <boost/date_time/posix_time/posix_time.hpp>
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#include <windows.h>
+#else
+#include <chrono>
+#endif
 #include <cuda_runtime.h>
 
 
@@ -8,6 +12,24 @@
 
 namespace caffe {
 
+#if defined(_MSC_VER) && _MSC_VER < 1900
+int64_t MonotonicMicros() {
+  // Not cached in a local static, whose initialization VS2012 does not make
+  // thread-safe; the frequency is fixed at boot and cheap to read.
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  // Split so that counter * 1000000 cannot overflow.
+  return counter.QuadPart / frequency.QuadPart * 1000000 +
+      counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+#else
+int64_t MonotonicMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
 Timer::Timer()
     : initted_(false),
       running_(false),
@@ -27,7 +49,7 @@ void Timer::Start() {
     if (Caffe::mode() == Caffe::GPU) {
       CUDA_CHECK(cudaEventRecord(start_gpu_, 0));
     } else {
-      start_cpu_ = boost::posix_time::microsec_clock::local_time();
+      start_cpu_ = MonotonicMicros();
     }
     running_ = true;
     has_run_at_least_once_ = true;
@@ -40,12 +62,31 @@ void Timer::Stop() {
       CUDA_CHECK(cudaEventRecord(stop_gpu_, 0));
       CUDA_CHECK(cudaEventSynchronize(stop_gpu_));
     } else {
-      stop_cpu_ = boost::posix_time::microsec_clock::local_time();
+      stop_cpu_ = MonotonicMicros();
     }
     running_ = false;
   }
 }
 
+float Timer::MicroSeconds() {
+  if (!has_run_at_least_once()) {
+    LOG(WARNING) << "Timer has never been run before reading time.";
+    return 0;
+  }
+  if (running()) {
+    Stop();
+  }
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaEventElapsedTime(&elapsed_milliseconds_, start_gpu_,
+                                    stop_gpu_));
+    // CUDA events have a resolution of about half a microsecond.
+    elapsed_microseconds_ = elapsed_milliseconds_ * 1000;
+  } else {
+    elapsed_microseconds_ = stop_cpu_ - start_cpu_;
+  }
+  return elapsed_microseconds_;
+}
+
 float Timer::MilliSeconds() {
   if (!has_run_at_least_once()) {
     LOG(WARNING) << "Timer has never been run before reading time.";
@@ -58,7 +99,7 @@ float Timer::MilliSeconds() {
     CUDA_CHECK(cudaEventElapsedTime(&elapsed_milliseconds_, start_gpu_,
                                     stop_gpu_));
   } else {
-    elapsed_milliseconds_ = (stop_cpu_ - start_cpu_).total_milliseconds();
+    elapsed_milliseconds_ = (stop_cpu_ - start_cpu_) / 1000.;
   }
   return elapsed_milliseconds_;
 }
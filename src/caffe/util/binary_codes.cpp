@@ -0,0 +1,151 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/binary_codes.hpp"
+
+namespace caffe {
+
+static const char kBinaryCodeMagic[4] = { 'C', 'B', 'C', 'T' };
+static const uint32_t kBinaryCodeVersion = 1;
+
+struct BinaryCodeHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_codes;
+  uint32_t num_bits;
+  uint32_t reserved;
+};
+
+static void PackBits(const float* features, const int num_bits,
+    const float threshold, uint64_t* words) {
+  const int words_per_code = (num_bits + 63) / 64;
+  memset(words, 0, words_per_code * sizeof(uint64_t));
+  for (int i = 0; i < num_bits; ++i) {
+    if (features[i] > threshold) {
+      words[i / 64] |= uint64_t(1) << (i % 64);
+    }
+  }
+}
+
+void BinaryCodeTable::Binarize(const float* features, const int rows,
+    const int dim, const float threshold) {
+  CHECK_GE(rows, 0);
+  CHECK_GT(dim, 0);
+  num_codes_ = rows;
+  num_bits_ = dim;
+  words_per_code_ = (dim + 63) / 64;
+  words_.resize(static_cast<size_t>(rows) * words_per_code_);
+  for (int n = 0; n < rows; ++n) {
+    PackBits(features + static_cast<size_t>(n) * dim, dim, threshold,
+        &words_[static_cast<size_t>(n) * words_per_code_]);
+  }
+}
+
+void BinaryCodeTable::BinarizeQuery(const float* features,
+    const float threshold, std::vector<uint64_t>* code) const {
+  code->resize(words_per_code_);
+  PackBits(features, num_bits_, threshold, &(*code)[0]);
+}
+
+void BinaryCodeTable::Write(const string& filename) const {
+  FILE* file = fopen(filename.c_str(), "wb");
+  CHECK(file) << "Failed to open " << filename;
+  BinaryCodeHeader header;
+  memcpy(header.magic, kBinaryCodeMagic, sizeof(header.magic));
+  header.version = kBinaryCodeVersion;
+  header.num_codes = num_codes_;
+  header.num_bits = num_bits_;
+  header.reserved = 0;
+  CHECK_EQ(fwrite(&header, sizeof(header), 1, file), 1)
+      << "Failed to write " << filename;
+  CHECK_EQ(fwrite(words_.data(), sizeof(uint64_t), words_.size(), file),
+      words_.size()) << "Failed to write " << filename;
+  CHECK_EQ(fclose(file), 0) << "Failed to close " << filename;
+}
+
+bool BinaryCodeTable::Read(const string& filename) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file) {
+    LOG(ERROR) << "Could not open " << filename;
+    return false;
+  }
+  BinaryCodeHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+      memcmp(header.magic, kBinaryCodeMagic, sizeof(header.magic)) == 0 &&
+      header.version == kBinaryCodeVersion && header.num_bits > 0;
+  if (ok) {
+    num_codes_ = header.num_codes;
+    num_bits_ = header.num_bits;
+    words_per_code_ = (num_bits_ + 63) / 64;
+    words_.resize(static_cast<size_t>(num_codes_) * words_per_code_);
+    ok = fread(words_.data(), sizeof(uint64_t), words_.size(), file) ==
+        words_.size();
+  }
+  fclose(file);
+  if (!ok) {
+    LOG(ERROR) << filename << " is not a binary code table";
+  }
+  return ok;
+}
+
+void BinaryCodeTable::SearchRange(const uint64_t* query, const int k,
+    const int begin, const int end,
+    std::vector<std::pair<int, int> >* results) const {
+  // A max-heap of the k nearest so far; the top is the one to replace.
+  std::priority_queue<std::pair<int, int> > nearest;
+  // data() rather than code(0), which indexes words_ and may be empty.
+  const uint64_t* codes = words_.data();
+  for (int n = begin; n < end; ++n) {
+    const uint64_t* c = codes + static_cast<size_t>(n) * words_per_code_;
+    int distance = 0;
+    for (int w = 0; w < words_per_code_; ++w) {
+      distance += popcount64(c[w] ^ query[w]);
+    }
+    if (static_cast<int>(nearest.size()) < k) {
+      nearest.push(std::make_pair(distance, n));
+    } else if (distance < nearest.top().first) {
+      nearest.pop();
+      nearest.push(std::make_pair(distance, n));
+    }
+  }
+  for (; !nearest.empty(); nearest.pop()) {
+    results->push_back(nearest.top());
+  }
+}
+
+void BinaryCodeTable::Search(const uint64_t* query, const int k,
+    WorkerPool* pool, std::vector<std::pair<int, int> >* results) const {
+  CHECK_GT(k, 0);
+  results->clear();
+  const int num_ranges = pool ?
+      std::min(pool->num_workers(), std::max(num_codes_, 1)) : 1;
+  std::vector<std::vector<std::pair<int, int> > > range_results(num_ranges);
+  if (num_ranges == 1) {
+    SearchRange(query, k, 0, num_codes_, &range_results[0]);
+  } else {
+    pool->Run(num_ranges, 0, [&](int r, rng_t*) {
+      const int begin = static_cast<int64_t>(r) * num_codes_ / num_ranges;
+      const int end = static_cast<int64_t>(r + 1) * num_codes_ / num_ranges;
+      SearchRange(query, k, begin, end, &range_results[r]);
+    });
+  }
+  for (int r = 0; r < num_ranges; ++r) {
+    results->insert(results->end(), range_results[r].begin(),
+        range_results[r].end());
+  }
+  const int num_results = std::min<int>(k, results->size());
+  std::partial_sort(results->begin(), results->begin() + num_results,
+      results->end());
+  results->resize(num_results);
+}
+
+}  // namespace caffe
@@ -0,0 +1,90 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+
+#include "caffe/util/command_line.hpp"
+
+namespace caffe {
+
+CommandLineFlags::CommandLineFlags(int* argc, char** argv) {
+  int kept = 1;
+  for (int i = 1; i < *argc; ++i) {
+    const string arg(argv[i]);
+    if (arg.size() <= 2 || arg.compare(0, 2, "--") != 0) {
+      argv[kept++] = argv[i];
+      continue;
+    }
+    const size_t equals = arg.find('=');
+    if (equals == string::npos) {
+      values_[arg.substr(2)] = "1";
+    } else {
+      values_[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+    }
+  }
+  *argc = kept;
+  argv[kept] = NULL;
+}
+
+bool CommandLineFlags::Has(const string& name) const {
+  return values_.find(name) != values_.end();
+}
+
+string CommandLineFlags::GetString(const string& name,
+    const string& default_value) {
+  used_.insert(name);
+  std::map<string, string>::const_iterator it = values_.find(name);
+  return it == values_.end() ? default_value : it->second;
+}
+
+int CommandLineFlags::GetInt(const string& name, const int default_value) {
+  used_.insert(name);
+  std::map<string, string>::const_iterator it = values_.find(name);
+  if (it == values_.end()) {
+    return default_value;
+  }
+  char* end;
+  const long value = strtol(it->second.c_str(), &end, 10);  // NOLINT
+  CHECK(!it->second.empty() && *end == '\0')
+      << "--" << name << " expects an integer, got " << it->second;
+  return static_cast<int>(value);
+}
+
+double CommandLineFlags::GetDouble(const string& name,
+    const double default_value) {
+  used_.insert(name);
+  std::map<string, string>::const_iterator it = values_.find(name);
+  if (it == values_.end()) {
+    return default_value;
+  }
+  char* end;
+  const double value = strtod(it->second.c_str(), &end);
+  CHECK(!it->second.empty() && *end == '\0')
+      << "--" << name << " expects a number, got " << it->second;
+  return value;
+}
+
+bool CommandLineFlags::GetBool(const string& name, const bool default_value) {
+  used_.insert(name);
+  std::map<string, string>::const_iterator it = values_.find(name);
+  if (it == values_.end()) {
+    return default_value;
+  }
+  if (it->second == "1" || it->second == "true") {
+    return true;
+  }
+  CHECK(it->second == "0" || it->second == "false")
+      << "--" << name << " expects 0/1 or true/false, got " << it->second;
+  return false;
+}
+
+void CommandLineFlags::CheckAllUsed() const {
+  for (std::map<string, string>::const_iterator it = values_.begin();
+       it != values_.end(); ++it) {
+    CHECK(used_.count(it->first)) << "Unknown flag --" << it->first;
+  }
+}
+
+}  // namespace caffe
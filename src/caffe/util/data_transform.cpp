@@ -0,0 +1,183 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CAFFE_TRANSFORM_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "caffe/util/data_transform.hpp"
+
+namespace caffe {
+
+// The vectorized row kernels only handle contiguous rows, and return how many
+// leading values of the row they wrote; the caller finishes the tail. Types
+// without a kernel write nothing.
+template <typename Dtype, typename SrcType>
+static int transform_row_simd(const int /*n*/, const SrcType* /*src*/,
+    const Dtype* /*mean*/, const Dtype /*scale*/, const bool /*mirror*/,
+    Dtype* /*dst*/) {
+  return 0;
+}
+
+#ifdef CAFFE_TRANSFORM_SSE2
+// Stores the 4 transformed values for row positions [j, j + 4).
+template <bool kMirror>
+static inline void store4(const int n, const int j, __m128 x, float* dst) {
+  if (kMirror) {
+    _mm_storeu_ps(dst + n - j - 4,
+        _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 1, 2, 3)));
+  } else {
+    _mm_storeu_ps(dst + j, x);
+  }
+}
+
+template <bool kMirror>
+static int transform_row_uint8(const int n, const uint8_t* src,
+    const float* mean, const float scale, float* dst) {
+  int j = 0;
+#ifdef __AVX2__
+  const __m256 vscale8 = _mm256_set1_ps(scale);
+  const __m256i reverse8 = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (; j + 8 <= n; j += 8) {
+    const __m256i bytes = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + j)));
+    __m256 x = _mm256_sub_ps(_mm256_cvtepi32_ps(bytes),
+        _mm256_loadu_ps(mean + j));
+    x = _mm256_mul_ps(x, vscale8);
+    if (kMirror) {
+      _mm256_storeu_ps(dst + n - j - 8,
+          _mm256_permutevar8x32_ps(x, reverse8));
+    } else {
+      _mm256_storeu_ps(dst + j, x);
+    }
+  }
+#endif
+  const __m128 vscale = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  for (; j + 16 <= n; j += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+    const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    const __m128 x0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    const __m128 x1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    const __m128 x2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    const __m128 x3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+    store4<kMirror>(n, j, _mm_mul_ps(
+        _mm_sub_ps(x0, _mm_loadu_ps(mean + j)), vscale), dst);
+    store4<kMirror>(n, j + 4, _mm_mul_ps(
+        _mm_sub_ps(x1, _mm_loadu_ps(mean + j + 4)), vscale), dst);
+    store4<kMirror>(n, j + 8, _mm_mul_ps(
+        _mm_sub_ps(x2, _mm_loadu_ps(mean + j + 8)), vscale), dst);
+    store4<kMirror>(n, j + 12, _mm_mul_ps(
+        _mm_sub_ps(x3, _mm_loadu_ps(mean + j + 12)), vscale), dst);
+  }
+  for (; j + 4 <= n; j += 4) {
+    int32_t packed;
+    memcpy(&packed, src + j, sizeof(packed));
+    __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    words = _mm_unpacklo_epi16(words, zero);
+    __m128 x = _mm_sub_ps(_mm_cvtepi32_ps(words), _mm_loadu_ps(mean + j));
+    store4<kMirror>(n, j, _mm_mul_ps(x, vscale), dst);
+  }
+  return j;
+}
+
+static int transform_row_simd(const int n, const uint8_t* src,
+    const float* mean, const float scale, const bool mirror, float* dst) {
+  return mirror ? transform_row_uint8<true>(n, src, mean, scale, dst)
+      : transform_row_uint8<false>(n, src, mean, scale, dst);
+}
+
+template <bool kMirror>
+static int transform_row_float(const int n, const float* src,
+    const float* mean, const float scale, float* dst) {
+  int j = 0;
+#ifdef __AVX__
+  const __m256 vscale8 = _mm256_set1_ps(scale);
+  for (; j + 8 <= n; j += 8) {
+    __m256 x = _mm256_sub_ps(_mm256_loadu_ps(src + j),
+        _mm256_loadu_ps(mean + j));
+    x = _mm256_mul_ps(x, vscale8);
+    if (kMirror) {
+      // Reverse within each 128-bit lane, then swap the lanes.
+      x = _mm256_permute_ps(x, _MM_SHUFFLE(0, 1, 2, 3));
+      _mm256_storeu_ps(dst + n - j - 8, _mm256_permute2f128_ps(x, x, 0x01));
+    } else {
+      _mm256_storeu_ps(dst + j, x);
+    }
+  }
+#endif
+  const __m128 vscale = _mm_set1_ps(scale);
+  for (; j + 4 <= n; j += 4) {
+    __m128 x = _mm_sub_ps(_mm_loadu_ps(src + j), _mm_loadu_ps(mean + j));
+    store4<kMirror>(n, j, _mm_mul_ps(x, vscale), dst);
+  }
+  return j;
+}
+
+static int transform_row_simd(const int n, const float* src,
+    const float* mean, const float scale, const bool mirror, float* dst) {
+  return mirror ? transform_row_float<true>(n, src, mean, scale, dst)
+      : transform_row_float<false>(n, src, mean, scale, dst);
+}
+#endif  // CAFFE_TRANSFORM_SSE2
+
+template <typename Dtype, typename SrcType>
+void caffe_transform_row(const int n, const SrcType* src, const int src_stride,
+    const Dtype* mean, const Dtype scale, const bool mirror, Dtype* dst) {
+  int j = 0;
+  if (src_stride == 1) {
+    j = transform_row_simd(n, src, mean, scale, mirror, dst);
+  }
+  for (; j < n; ++j) {
+    const Dtype value =
+        (static_cast<Dtype>(src[j * src_stride]) - mean[j]) * scale;
+    dst[mirror ? n - 1 - j : j] = value;
+  }
+}
+
+template <typename Dtype, typename SrcType>
+void caffe_transform(const int count, const SrcType* src, const Dtype* mean,
+    const Dtype scale, Dtype* dst) {
+  caffe_transform_row(count, src, 1, mean, scale, false, dst);
+}
+
+template <typename Dtype, typename SrcType>
+void caffe_transform_crop(const int channels, const int height,
+    const int width, const int h_off, const int w_off, const int crop_height,
+    const int crop_width, const bool mirror, const SrcType* src,
+    const Dtype* mean, const Dtype scale, Dtype* dst) {
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_height; ++h) {
+      const int data_index = (c * height + h + h_off) * width + w_off;
+      caffe_transform_row(crop_width, src + data_index, 1, mean + data_index,
+          scale, mirror, dst + (c * crop_height + h) * crop_width);
+    }
+  }
+}
+
+#define INSTANTIATE_TRANSFORM(Dtype, SrcType) \
+  template void caffe_transform_row<Dtype, SrcType>(const int n, \
+      const SrcType* src, const int src_stride, const Dtype* mean, \
+      const Dtype scale, const bool mirror, Dtype* dst); \
+  template void caffe_transform<Dtype, SrcType>(const int count, \
+      const SrcType* src, const Dtype* mean, const Dtype scale, Dtype* dst); \
+  template void caffe_transform_crop<Dtype, SrcType>(const int channels, \
+      const int height, const int width, const int h_off, const int w_off, \
+      const int crop_height, const int crop_width, const bool mirror, \
+      const SrcType* src, const Dtype* mean, const Dtype scale, Dtype* dst)
+
+INSTANTIATE_TRANSFORM(float, uint8_t);
+INSTANTIATE_TRANSFORM(float, float);
+INSTANTIATE_TRANSFORM(double, uint8_t);
+INSTANTIATE_TRANSFORM(double, float);
+
+}  // namespace caffe
@@ -0,0 +1,352 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#ifdef USE_LMDB
+#include <lmdb.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#endif  // USE_LMDB
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+
+using std::string;
+
+namespace caffe {
+namespace db {
+
+// LevelDB
+
+class LevelDBCursor : public Cursor {
+ public:
+  explicit LevelDBCursor(leveldb::Iterator* iter) : iter_(iter) {
+    SeekToFirst();
+  }
+  virtual ~LevelDBCursor() { delete iter_; }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); }
+  virtual bool Seek(const string& key) {
+    iter_->Seek(key);
+    return iter_->Valid();
+  }
+  virtual void Next() { iter_->Next(); }
+  virtual bool valid() const { return iter_->Valid(); }
+  virtual string key() const { return iter_->key().ToString(); }
+  virtual const char* value_data() const { return iter_->value().data(); }
+  virtual size_t value_size() const { return iter_->value().size(); }
+
+ private:
+  leveldb::Iterator* iter_;
+};
+
+class LevelDBTransaction : public Transaction {
+ public:
+  explicit LevelDBTransaction(leveldb::DB* db) : db_(db) { CHECK(db_); }
+  virtual void Put(const string& key, const string& value) {
+    batch_.Put(key, value);
+  }
+  virtual void Commit() {
+    leveldb::Status status = db_->Write(leveldb::WriteOptions(), &batch_);
+    CHECK(status.ok()) << "Failed to write batch to leveldb "
+        << std::endl << status.ToString();
+    batch_.Clear();
+  }
+
+ private:
+  leveldb::DB* db_;
+  leveldb::WriteBatch batch_;
+};
+
+class LevelDB : public DB {
+ public:
+  LevelDB() : db_(NULL) {}
+  virtual ~LevelDB() { Close(); }
+  virtual void Open(const string& source, Mode mode) {
+    leveldb::Options options;
+    options.max_open_files = 100;
+    options.create_if_missing = mode != READ;
+    options.error_if_exists = mode == NEW;
+    if (mode != READ) {
+      options.write_buffer_size = 268435456;
+    }
+    LOG(INFO) << "Opening leveldb " << source;
+    leveldb::Status status = leveldb::DB::Open(options, source, &db_);
+    CHECK(status.ok()) << "Failed to open leveldb " << source
+        << std::endl << status.ToString();
+  }
+  virtual void Close() {
+    delete db_;
+    db_ = NULL;
+  }
+  virtual Cursor* NewCursor() {
+    leveldb::ReadOptions read_options;
+    // Records are streamed once per epoch, so caching them only evicts
+    // the index blocks.
+    read_options.fill_cache = false;
+    return new LevelDBCursor(db_->NewIterator(read_options));
+  }
+  virtual Transaction* NewTransaction() {
+    return new LevelDBTransaction(db_);
+  }
+
+ private:
+  leveldb::DB* db_;
+};
+
+// LMDB, built with USE_LMDB, as the dependency bundle does not have it.
+#ifdef USE_LMDB
+
+#define MDB_CHECK(condition) \
+  do { \
+    int mdb_status = condition; \
+    CHECK_EQ(mdb_status, MDB_SUCCESS) << mdb_strerror(mdb_status); \
+  } while (0)
+
+class LMDBCursor : public Cursor {
+ public:
+  LMDBCursor(MDB_txn* txn, MDB_cursor* cursor)
+      : txn_(txn), cursor_(cursor), valid_(false) {
+    SeekToFirst();
+  }
+  virtual ~LMDBCursor() {
+    mdb_cursor_close(cursor_);
+    mdb_txn_abort(txn_);
+  }
+  virtual void SeekToFirst() { Seek(MDB_FIRST); }
+  virtual void SeekToLast() { Seek(MDB_LAST); }
+  virtual bool Seek(const string& key) {
+    // MDB_SET_RANGE reads the key to look for and replaces it with the key
+    // found.
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_RANGE);
+    return valid_;
+  }
+  virtual void Next() { Seek(MDB_NEXT); }
+  virtual bool valid() const { return valid_; }
+  virtual string key() const {
+    return string(static_cast<const char*>(mdb_key_.mv_data),
+        mdb_key_.mv_size);
+  }
+  virtual const char* value_data() const {
+    return static_cast<const char*>(mdb_value_.mv_data);
+  }
+  virtual size_t value_size() const { return mdb_value_.mv_size; }
+  // The read-only transaction keeps every page it has seen mapped.
+  virtual bool values_stable() const { return true; }
+
+ private:
+  void Seek(MDB_cursor_op op) {
+    int mdb_status = mdb_cursor_get(cursor_, &mdb_key_, &mdb_value_, op);
+    if (mdb_status == MDB_NOTFOUND) {
+      valid_ = false;
+    } else {
+      MDB_CHECK(mdb_status);
+      valid_ = true;
+    }
+  }
+
+  MDB_txn* txn_;
+  MDB_cursor* cursor_;
+  MDB_val mdb_key_, mdb_value_;
+  bool valid_;
+};
+
+class LMDBTransaction : public Transaction {
+ public:
+  explicit LMDBTransaction(MDB_env* env) : env_(env) { CHECK(env_); }
+  virtual void Put(const string& key, const string& value) {
+    keys_.push_back(key);
+    values_.push_back(value);
+  }
+  // Writes the buffered records in one write transaction. If the map is
+  // full it is doubled and the write retried.
+  virtual void Commit() {
+    while (!TryCommit()) {
+      MDB_envinfo info;
+      MDB_CHECK(mdb_env_info(env_, &info));
+      const size_t new_size = info.me_mapsize * 2;
+      LOG(INFO) << "Growing lmdb map to " << (new_size >> 20) << "MB";
+      MDB_CHECK(mdb_env_set_mapsize(env_, new_size));
+    }
+    keys_.clear();
+    values_.clear();
+  }
+
+ private:
+  bool TryCommit() {
+    MDB_txn* txn;
+    MDB_dbi dbi;
+    MDB_CHECK(mdb_txn_begin(env_, NULL, 0, &txn));
+    MDB_CHECK(mdb_dbi_open(txn, NULL, 0, &dbi));
+    for (int i = 0; i < keys_.size(); ++i) {
+      MDB_val mdb_key, mdb_value;
+      mdb_key.mv_size = keys_[i].size();
+      mdb_key.mv_data = const_cast<char*>(keys_[i].data());
+      mdb_value.mv_size = values_[i].size();
+      mdb_value.mv_data = const_cast<char*>(values_[i].data());
+      int mdb_status = mdb_put(txn, dbi, &mdb_key, &mdb_value, 0);
+      if (mdb_status == MDB_MAP_FULL) {
+        mdb_txn_abort(txn);
+        return false;
+      }
+      MDB_CHECK(mdb_status);
+    }
+    int mdb_status = mdb_txn_commit(txn);
+    if (mdb_status == MDB_MAP_FULL) {
+      return false;
+    }
+    MDB_CHECK(mdb_status);
+    return true;
+  }
+
+  MDB_env* env_;
+  std::vector<string> keys_, values_;
+};
+
+class LMDB : public DB {
+ public:
+  LMDB() : env_(NULL) {}
+  virtual ~LMDB() { Close(); }
+  virtual void Open(const string& source, Mode mode) {
+    MDB_CHECK(mdb_env_create(&env_));
+    if (mode == NEW) {
+#ifdef _MSC_VER
+      CHECK_EQ(_mkdir(source.c_str()), 0) << "mkdir " << source << " failed";
+#else
+      CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source
+          << " failed";
+#endif
+    }
+    // Writers start from a small map and grow it on demand; a large initial
+    // map would be allocated up front on some platforms.
+    if (mode != READ) {
+      MDB_CHECK(mdb_env_set_mapsize(env_, 1 << 30));
+    }
+    const int flags = (mode == READ) ? MDB_RDONLY | MDB_NOTLS : 0;
+    LOG(INFO) << "Opening lmdb " << source;
+    MDB_CHECK(mdb_env_open(env_, source.c_str(), flags, 0664));
+  }
+  virtual void Close() {
+    if (env_ != NULL) {
+      mdb_env_close(env_);
+      env_ = NULL;
+    }
+  }
+  virtual Cursor* NewCursor() {
+    MDB_txn* txn;
+    MDB_dbi dbi;
+    MDB_cursor* cursor;
+    MDB_CHECK(mdb_txn_begin(env_, NULL, MDB_RDONLY, &txn));
+    MDB_CHECK(mdb_dbi_open(txn, NULL, 0, &dbi));
+    MDB_CHECK(mdb_cursor_open(txn, dbi, &cursor));
+    return new LMDBCursor(txn, cursor);
+  }
+  virtual Transaction* NewTransaction() {
+    return new LMDBTransaction(env_);
+  }
+
+ private:
+  MDB_env* env_;
+};
+
+#endif  // USE_LMDB
+
+string InterpolateKey(const string& first, const string& last,
+    double fraction) {
+  size_t prefix = 0;
+  while (prefix < first.size() && prefix < last.size() &&
+         first[prefix] == last[prefix]) {
+    ++prefix;
+  }
+  size_t first_digits = 0;
+  while (prefix + first_digits < first.size() &&
+         isdigit(static_cast<unsigned char>(first[prefix + first_digits]))) {
+    ++first_digits;
+  }
+  size_t last_digits = 0;
+  while (prefix + last_digits < last.size() &&
+         isdigit(static_cast<unsigned char>(last[prefix + last_digits]))) {
+    ++last_digits;
+  }
+  string key = first.substr(0, prefix);
+  if (first_digits > 0 && first_digits == last_digits) {
+    // Digits past the fifteenth are left out, as a double cannot hold them.
+    const int digits = std::min<int>(first_digits, 15);
+    const double a = atof(first.substr(prefix, digits).c_str());
+    const double b = atof(last.substr(prefix, digits).c_str());
+    // At most 15 digits, so the buffer cannot overflow; VS2012 has no
+    // snprintf.
+    char buffer[32];
+    sprintf(buffer, "%0*.0f", digits,  // NOLINT(runtime/printf)
+        floor(a + fraction * (b - a)));
+    return std::min(key + buffer, last);
+  }
+  const int bytes = 6;
+  double a = 0;
+  double b = 0;
+  for (int i = 0; i < bytes; ++i) {
+    a = a * 256 + (prefix + i < first.size() ?
+        static_cast<unsigned char>(first[prefix + i]) : 0);
+    b = b * 256 + (prefix + i < last.size() ?
+        static_cast<unsigned char>(last[prefix + i]) : 0);
+  }
+  uint64_t value = static_cast<uint64_t>(floor(a + fraction * (b - a)));
+  string suffix(bytes, '\0');
+  for (int i = bytes - 1; i >= 0; --i) {
+    suffix[i] = static_cast<char>(value & 255);
+    value >>= 8;
+  }
+  // A key shorter than the bytes was padded with zeros, which sorts after
+  // the key itself; the padding is dropped so that Seek finds the key.
+  size_t end = bytes;
+  while (end > 0 && suffix[end - 1] == '\0') {
+    --end;
+  }
+  return std::min(key + suffix.substr(0, end), last);
+}
+
+DB* GetDB(DataParameter::DB backend) {
+  switch (backend) {
+  case DataParameter_DB_LEVELDB:
+    return new LevelDB();
+  case DataParameter_DB_LMDB:
+#ifdef USE_LMDB
+    return new LMDB();
+#else
+    LOG(FATAL) << "LMDB support was not built; define USE_LMDB.";
+    break;
+#endif  // USE_LMDB
+  default:
+    LOG(FATAL) << "Unknown database backend " << backend;
+  }
+  return NULL;
+}
+
+DB* GetDB(const string& backend) {
+  if (backend == "leveldb") {
+    return new LevelDB();
+  } else if (backend == "lmdb") {
+    return GetDB(DataParameter_DB_LMDB);
+  }
+  LOG(FATAL) << "Unknown database backend " << backend;
+  return NULL;
+}
+
+}  // namespace db
+}  // namespace caffe
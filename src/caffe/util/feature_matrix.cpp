@@ -0,0 +1,81 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/util/feature_matrix.hpp"
+
+namespace caffe {
+
+static const char kFeatureMatrixMagic[4] = { 'C', 'F', 'M', 'X' };
+static const uint32_t kFeatureMatrixVersion = 1;
+
+FeatureMatrixWriter::FeatureMatrixWriter(const string& filename,
+    const int cols)
+    : file_(NULL), filename_(filename), rows_(0), cols_(cols) {
+  CHECK_GT(cols_, 0);
+  file_ = fopen(filename_.c_str(), "wb");
+  CHECK(file_) << "Failed to open " << filename_;
+  FeatureMatrixHeader header;
+  memcpy(header.magic, kFeatureMatrixMagic, sizeof(header.magic));
+  header.version = kFeatureMatrixVersion;
+  header.rows = 0;
+  header.cols = cols_;
+  CHECK_EQ(fwrite(&header, sizeof(header), 1, file_), 1)
+      << "Failed to write " << filename_;
+}
+
+FeatureMatrixWriter::~FeatureMatrixWriter() {
+  Close();
+}
+
+void FeatureMatrixWriter::AppendRows(const float* data, const int num_rows) {
+  CHECK(file_) << filename_ << " is closed";
+  const size_t count = static_cast<size_t>(num_rows) * cols_;
+  CHECK_EQ(fwrite(data, sizeof(float), count, file_), count)
+      << "Failed to write " << filename_;
+  rows_ += num_rows;
+}
+
+void FeatureMatrixWriter::Close() {
+  if (!file_) {
+    return;
+  }
+  CHECK_EQ(fseek(file_, offsetof(FeatureMatrixHeader, rows), SEEK_SET), 0);
+  CHECK_EQ(fwrite(&rows_, sizeof(rows_), 1, file_), 1)
+      << "Failed to write " << filename_;
+  CHECK_EQ(fclose(file_), 0) << "Failed to close " << filename_;
+  file_ = NULL;
+}
+
+bool ReadFeatureMatrix(const string& filename, uint64_t* rows, int* cols,
+    std::vector<float>* data) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file) {
+    LOG(ERROR) << "Could not open " << filename;
+    return false;
+  }
+  FeatureMatrixHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+      memcmp(header.magic, kFeatureMatrixMagic, sizeof(header.magic)) == 0 &&
+      header.version == kFeatureMatrixVersion;
+  if (ok) {
+    const size_t count = header.rows * header.cols;
+    data->resize(count);
+    ok = count == 0 || fread(&(*data)[0], sizeof(float), count, file) == count;
+    *rows = header.rows;
+    *cols = header.cols;
+  }
+  fclose(file);
+  if (!ok) {
+    LOG(ERROR) << filename << " is not a feature matrix";
+  }
+  return ok;
+}
+
+}  // namespace caffe
@@ -0,0 +1,176 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <glog/logging.h>
+#include <stdlib.h>
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+// std::max and EXPECT_EQ take them by reference, which needs a definition.
+const size_t HostMemoryPool::kAlignment;
+const size_t HostMemoryPool::kHugePageSize;
+
+HostMemoryPool& HostMemoryPool::Get() {
+  static HostMemoryPool* pool = new HostMemoryPool();
+  return *pool;
+}
+
+size_t HostMemoryPool::SizeClass(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // Four classes between power and 2 * power.
+  size_t power = kAlignment;
+  while (power * 2 < size) {
+    power *= 2;
+  }
+  const size_t step = std::max(kAlignment, power / 4);
+  return (size + step - 1) / step * step;
+}
+
+HostMemoryPool::HostMemoryPool()
+    : huge_pages_(false),
+      max_held_bytes_set_(false),
+      max_held_bytes_(0) {
+  stats_.hits = 0;
+  stats_.misses = 0;
+  stats_.bytes_in_use = 0;
+  stats_.bytes_held = 0;
+  stats_.peak_bytes_in_use = 0;
+}
+
+HostMemoryPool::~HostMemoryPool() {
+  Trim();
+}
+
+void* HostMemoryPool::Allocate(size_t size) {
+  const size_t block_size = SizeClass(size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.bytes_in_use += block_size;
+    stats_.peak_bytes_in_use =
+        std::max(stats_.peak_bytes_in_use, stats_.bytes_in_use);
+    std::map<size_t, vector<void*> >::iterator it = held_.find(block_size);
+    if (it != held_.end() && !it->second.empty()) {
+      void* ptr = it->second.back();
+      it->second.pop_back();
+      stats_.bytes_held -= block_size;
+      ++stats_.hits;
+      return ptr;
+    }
+    ++stats_.misses;
+  }
+  return SystemAllocate(block_size);
+}
+
+void HostMemoryPool::Free(void* ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+  const size_t block_size = SizeClass(size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK_GE(stats_.bytes_in_use, block_size);
+    stats_.bytes_in_use -= block_size;
+    const size_t max_held_bytes = max_held_bytes_set_ ?
+        max_held_bytes_ : stats_.peak_bytes_in_use / 4;
+    if (stats_.bytes_held + block_size <= max_held_bytes) {
+      held_[block_size].push_back(ptr);
+      stats_.bytes_held += block_size;
+      return;
+    }
+  }
+  SystemFree(ptr);
+}
+
+void HostMemoryPool::set_huge_pages(bool huge_pages) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  huge_pages_ = huge_pages;
+}
+
+void HostMemoryPool::set_max_held_bytes(size_t max_held_bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_held_bytes_set_ = true;
+    max_held_bytes_ = max_held_bytes;
+    if (stats_.bytes_held <= max_held_bytes_) {
+      return;
+    }
+  }
+  Trim();
+}
+
+void HostMemoryPool::Trim() {
+  std::map<size_t, vector<void*> > held;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held.swap(held_);
+    stats_.bytes_held = 0;
+  }
+  for (std::map<size_t, vector<void*> >::iterator it = held.begin();
+       it != held.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      SystemFree(it->second[i]);
+    }
+  }
+}
+
+HostMemoryPool::Stats HostMemoryPool::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void HostMemoryPool::LogStats() {
+  const Stats current = stats();
+  const uint64_t requests = current.hits + current.misses;
+  LOG(INFO) << "Host memory pool: " << current.bytes_in_use / 1048576.
+      << " MB in use (peak " << current.peak_bytes_in_use / 1048576.
+      << " MB), " << current.bytes_held / 1048576. << " MB held, "
+      << current.hits << " of " << requests << " allocations served by "
+      << "held blocks";
+}
+
+void* HostMemoryPool::SystemAllocate(size_t size) {
+  bool huge_pages;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    huge_pages = huge_pages_ && size >= kHugePageSize;
+  }
+  const size_t alignment = huge_pages ? kHugePageSize : kAlignment;
+  void* ptr = NULL;
+#ifdef _MSC_VER
+  ptr = _aligned_malloc(size, alignment);
+#else
+  if (posix_memalign(&ptr, alignment, size)) {
+    ptr = NULL;
+  }
+#endif
+  CHECK(ptr) << "Cannot allocate " << size << " bytes of host memory.";
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void HostMemoryPool::SystemFree(void* ptr) {
+#ifdef _MSC_VER
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+}  // namespace caffe
@@ -0,0 +1,89 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+ImageCache::ImageCache(const size_t max_bytes)
+    : max_bytes_(max_bytes),
+      bytes_(0),
+      hits_(0),
+      misses_(0),
+      evictions_(0) {}
+
+shared_ptr<const Datum> ImageCache::Get(const int key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<int, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++misses_;
+    return shared_ptr<const Datum>();
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second.second);
+  return it->second.first;
+}
+
+void ImageCache::Put(const int key, const shared_ptr<const Datum>& image) {
+  CHECK(image);
+  const size_t image_bytes = ImageBytes(*image);
+  if (image_bytes > max_bytes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Workers that missed on the same key at once may both insert it.
+  if (entries_.count(key)) {
+    return;
+  }
+  while (bytes_ + image_bytes > max_bytes_) {
+    Evict();
+  }
+  lru_.push_front(key);
+  entries_[key] = Entry(image, lru_.begin());
+  bytes_ += image_bytes;
+}
+
+void ImageCache::Evict() {
+  CHECK(!lru_.empty());
+  std::map<int, Entry>::iterator it = entries_.find(lru_.back());
+  bytes_ -= ImageBytes(*it->second.first);
+  entries_.erase(it);
+  lru_.pop_back();
+  ++evictions_;
+}
+
+size_t ImageCache::ImageBytes(const Datum& image) {
+  return image.data().size() + image.float_data_size() * sizeof(float);
+}
+
+size_t ImageCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+int ImageCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+uint64_t ImageCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t ImageCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+uint64_t ImageCache::evictions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return evictions_;
+}
+
+}  // namespace caffe
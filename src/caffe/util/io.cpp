@@ -1,8 +1,13 @@
 // Copyright 2014 BVLC and contributors.
 
 #include <stdint.h>
+#include <stdio.h>
 #include <fcntl.h>
 #include <io.h>
+#ifdef USE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif  // USE_LIBJPEG
 
 #include <google/protobuf/text_format.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -70,68 +75,201 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
-bool ReadImageToDatum(const string& filename, const int label,
-    const int height, const int width, Datum* datum) {
-  IplImage *cv_img = NULL;
-  if(height >0 && width > 0){
-    IplImage *cv_img_origin  = cvLoadImage(filename.c_str(), -1);
-	cv_img = cvCreateImage(cvSize(width,height), cv_img_origin->depth, cv_img_origin->nChannels);
-	cvResize(cv_img_origin , cv_img);
-	cvReleaseImage(&cv_img_origin);
-  }else{
-	  cv_img = cvLoadImage(filename.c_str(), -1);
+// Resizes cv_img to height x width if both are positive, releasing the
+// original.
+static IplImage* ResizeImage(IplImage* cv_img, const int height,
+    const int width) {
+  if (cv_img == NULL || height <= 0 || width <= 0 ||
+      (cv_img->height == height && cv_img->width == width)) {
+    return cv_img;
+  }
+  IplImage* cv_resized = cvCreateImage(cvSize(width, height), cv_img->depth,
+      cv_img->nChannels);
+  cvResize(cv_img, cv_resized);
+  cvReleaseImage(&cv_img);
+  return cv_resized;
+}
+
+#ifdef USE_LIBJPEG
+// libjpeg reports fatal errors through error_exit, which must not return;
+// this one jumps back to DecodeJpegScaled.
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+static void JpegOutputMessage(j_common_ptr) {}
+
+// Decodes a JPEG at the smallest of 1/8, 1/4, 1/2 or full scale that is still
+// at least height x width. libjpeg scales in the DCT, skipping most of the
+// decode work for large photos. Returns NULL for anything that is not a
+// grayscale or color JPEG, so that the caller can fall back to OpenCV. It
+// needs the jpeg_mem_src of libjpeg 8 or libjpeg-turbo, which the
+// dependency bundle does not have; define USE_LIBJPEG to build it.
+static IplImage* DecodeJpegScaled(const string& data, const int height,
+    const int width) {
+  if (data.size() < 2 || static_cast<uint8_t>(data[0]) != 0xFF ||
+      static_cast<uint8_t>(data[1]) != 0xD8) {
+    return NULL;
+  }
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager jerr;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = JpegErrorExit;
+  jerr.pub.output_message = JpegOutputMessage;
+  // Volatile, as it is read after a longjmp.
+  IplImage* volatile cv_img = NULL;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    IplImage* failed_img = cv_img;
+    if (failed_img != NULL) {
+      cvReleaseImage(&failed_img);
+    }
+    return NULL;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo,
+      reinterpret_cast<unsigned char*>(const_cast<char*>(data.data())),
+      data.size());
+  jpeg_read_header(&cinfo, TRUE);
+  if (cinfo.num_components != 1 && cinfo.num_components != 3) {
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
   }
-  unsigned char *dataPoint = (unsigned char *)cv_img->imageData;
-  if(dataPoint == NULL){
-	LOG(ERROR) << "Could not open or find file " << filename;
+  cinfo.out_color_space = (cinfo.num_components == 1) ? JCS_GRAYSCALE : JCS_RGB;
+  cinfo.scale_num = 1;
+  for (int denom = 8; denom > 1; denom /= 2) {
+    cinfo.scale_denom = denom;
+    jpeg_calc_output_dimensions(&cinfo);
+    if (cinfo.output_height >= height && cinfo.output_width >= width) {
+      break;
+    }
+    cinfo.scale_denom = 1;
+  }
+  jpeg_start_decompress(&cinfo);
+  const int channels = cinfo.output_components;
+  cv_img = cvCreateImage(cvSize(cinfo.output_width, cinfo.output_height),
+      IPL_DEPTH_8U, channels);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = reinterpret_cast<JSAMPROW>(
+        cv_img->imageData + cinfo.output_scanline * cv_img->widthStep);
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    if (channels == 3) {
+      // OpenCV images are BGR.
+      for (int w = 0; w < cinfo.output_width; ++w) {
+        std::swap(row[3 * w], row[3 * w + 2]);
+      }
+    }
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return cv_img;
+}
+#endif  // USE_LIBJPEG
+
+// Decodes an image file's bytes, resized to height x width if both are
+// positive. With USE_LIBJPEG, JPEGs that are resized are decoded at a reduced
+// scale first.
+static IplImage* DecodeImage(const string& data, const int height,
+    const int width) {
+  IplImage* cv_img = NULL;
+#ifdef USE_LIBJPEG
+  if (height > 0 && width > 0) {
+    cv_img = DecodeJpegScaled(data, height, width);
+  }
+#endif  // USE_LIBJPEG
+  if (cv_img == NULL) {
+    CvMat buffer = cvMat(1, data.size(), CV_8UC1,
+        const_cast<char*>(data.data()));
+    cv_img = cvDecodeImage(&buffer, -1);
+  }
+  return ResizeImage(cv_img, height, width);
+}
+
+static bool ReadFileToString(const string& filename, string* data) {
+  std::ifstream file(filename.c_str(), ios::in | ios::binary | ios::ate);
+  if (!file.is_open()) {
     return false;
   }
-  datum->set_channels(cv_img->nChannels);
-  datum->set_height(cv_img->height);
-  datum->set_width(cv_img->width);
-  datum->set_label(label);
+  const std::streampos size = file.tellg();
+  data->resize(size);
+  file.seekg(0, ios::beg);
+  return size == 0 || file.read(&(*data)[0], size);
+}
+
+// Copies the interleaved pixels of cv_img into datum as channels x height x
+// width bytes, and releases the image.
+static void ImageToDatum(IplImage* cv_img, Datum* datum) {
+  const int channels = cv_img->nChannels;
+  const int height = cv_img->height;
+  const int width = cv_img->width;
+  datum->set_channels(channels);
+  datum->set_height(height);
+  datum->set_width(width);
   datum->clear_data();
   datum->clear_float_data();
+  datum->clear_encoded();
   string* datum_string = datum->mutable_data();
-  for (int c = 0; c < cv_img->nChannels; ++c) {
-    for (int h = 0; h < cv_img->width; ++h) {
-      for (int w = 0; w < cv_img->height; ++w) {
-        datum_string->push_back(
-            dataPoint[h*cv_img->widthStep + w*cv_img->nChannels + c]);
+  datum_string->resize(channels * height * width);
+  char* data = &(*datum_string)[0];
+  for (int h = 0; h < height; ++h) {
+    const char* row = cv_img->imageData + h * cv_img->widthStep;
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        data[(c * height + h) * width + w] = row[w * channels + c];
       }
     }
   }
   cvReleaseImage(&cv_img);
-  
+}
 
-  /*cv::Mat cv_img;
+bool ReadImageToDatum(const string& filename, const int label,
+    const int height, const int width, Datum* datum) {
+  IplImage* cv_img = NULL;
   if (height > 0 && width > 0) {
-    cv::Mat cv_img_origin = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
-    cv::resize(cv_img_origin, cv_img, cv::Size(height, width));
+    string data;
+    if (ReadFileToString(filename, &data)) {
+      cv_img = DecodeImage(data, height, width);
+    }
   } else {
-    cv_img = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+    cv_img = cvLoadImage(filename.c_str(), -1);
   }
-  if (!cv_img.data) {
+  if (cv_img == NULL) {
     LOG(ERROR) << "Could not open or find file " << filename;
     return false;
   }
-  datum->set_channels(3);
-  datum->set_height(cv_img.rows);
-  datum->set_width(cv_img.cols);
+  ImageToDatum(cv_img, datum);
   datum->set_label(label);
-  datum->clear_data();
-  datum->clear_float_data();
-  string* datum_string = datum->mutable_data();
-  for (int c = 0; c < 3; ++c) {
-    for (int h = 0; h < cv_img.rows; ++h) {
-      for (int w = 0; w < cv_img.cols; ++w) {
-        datum_string->push_back(
-            static_cast<char>(cv_img.at<cv::Vec3b>(h, w)[c]));
-      }
-    }
-  }*/
   return true;
 }
+
+bool ReadFileToDatum(const string& filename, const int label,
+    Datum* datum) {
+  datum->Clear();
+  if (!ReadFileToString(filename, datum->mutable_data())) {
+    LOG(ERROR) << "Could not open or read file " << filename;
+    return false;
+  }
+  datum->set_label(label);
+  datum->set_encoded(true);
+  return true;
+}
+
+bool DecodeDatum(const int height, const int width, Datum* datum) {
+  CHECK(datum->encoded()) << "The datum is not encoded.";
+  IplImage* cv_img = DecodeImage(datum->data(), height, width);
+  if (cv_img == NULL) {
+    LOG(ERROR) << "Could not decode datum";
+    return false;
+  }
+  ImageToDatum(cv_img, datum);
+  return true;
+}
+
 /*
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
@@ -0,0 +1,127 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/memory_tracker.hpp"
+
+namespace caffe {
+
+const char* MemoryTracker::KindName(Kind kind) {
+  switch (kind) {
+  case DATA:
+    return "data";
+  case DIFF:
+    return "diff";
+  case PARAM:
+    return "param";
+  case WORKSPACE:
+    return "workspace";
+  case HISTORY:
+    return "history";
+  case PREFETCH:
+    return "prefetch";
+  default:
+    LOG(FATAL) << "Unknown memory kind " << kind;
+    return "";
+  }
+}
+
+int MemoryTracker::Register(const string& owner, Kind kind) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::pair<string, int> key(owner, kind);
+  std::map<std::pair<string, int>, int>::iterator it = tags_.find(key);
+  if (it != tags_.end()) {
+    return it->second;
+  }
+  Entry entry;
+  entry.owner = owner;
+  entry.kind = kind;
+  entry.current_bytes = 0;
+  entry.peak_bytes = 0;
+  entries_.push_back(entry);
+  tags_[key] = entries_.size() - 1;
+  return entries_.size() - 1;
+}
+
+void MemoryTracker::Allocate(int tag, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[tag];
+  entry.current_bytes += bytes;
+  entry.peak_bytes = std::max(entry.peak_bytes, entry.current_bytes);
+  current_bytes_ += bytes;
+  peak_bytes_ = std::max(peak_bytes_, current_bytes_);
+}
+
+void MemoryTracker::Free(int tag, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[tag];
+  CHECK_GE(entry.current_bytes, bytes);
+  entry.current_bytes -= bytes;
+  current_bytes_ -= bytes;
+}
+
+size_t MemoryTracker::current_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return current_bytes_;
+}
+
+size_t MemoryTracker::peak_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_bytes_;
+}
+
+size_t MemoryTracker::current_bytes(Kind kind) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (int i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].kind == kind) {
+      bytes += entries_[i].current_bytes;
+    }
+  }
+  return bytes;
+}
+
+vector<MemoryTracker::Entry> MemoryTracker::entries() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_;
+}
+
+namespace {
+
+bool LargerEntry(const MemoryTracker::Entry& a,
+                 const MemoryTracker::Entry& b) {
+  return a.current_bytes > b.current_bytes;
+}
+
+}  // namespace
+
+void MemoryTracker::Log(const string& name, int num_owners) {
+  vector<Entry> sorted = entries();
+  LOG(INFO) << "Host memory of " << name << ": "
+      << current_bytes() / 1048576. << " MB, peak "
+      << peak_bytes() / 1048576. << " MB";
+  for (int kind = 0; kind < kNumKinds; ++kind) {
+    const size_t bytes = current_bytes(static_cast<Kind>(kind));
+    if (bytes > 0) {
+      LOG(INFO) << "    " << KindName(static_cast<Kind>(kind)) << ": "
+          << bytes / 1048576. << " MB";
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(), LargerEntry);
+  for (int i = 0; i < std::min<int>(num_owners, sorted.size()); ++i) {
+    if (sorted[i].current_bytes == 0) {
+      break;
+    }
+    LOG(INFO) << "    " << sorted[i].owner << " ("
+        << KindName(sorted[i].kind) << "): "
+        << sorted[i].current_bytes / 1048576. << " MB, peak "
+        << sorted[i].peak_bytes / 1048576. << " MB";
+  }
+}
+
+}  // namespace caffe
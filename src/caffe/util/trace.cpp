@@ -0,0 +1,205 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/trace.hpp"
+
+using std::vector;
+
+namespace caffe {
+
+namespace {
+
+struct TraceEvent {
+  char name[Tracer::kMaxNameLength + 1];
+  const char* category;
+  int64_t begin_us;
+  int64_t end_us;
+};
+
+// The spans of one thread at a time. Only that thread writes to it; the
+// mutex is held by the writer so that the spans can be read while it keeps
+// running. The events grow as spans are recorded, up to capacity.
+struct TraceBuffer {
+  std::mutex mutex;
+  int tid;
+  int capacity;
+  vector<TraceEvent> events;
+  // Total number of spans recorded; the oldest is at next % events.size()
+  // once the buffer has wrapped around.
+  uint64_t next;
+};
+
+std::mutex registry_mutex;
+vector<shared_ptr<TraceBuffer> > registry;
+// Buffers handed back by threads that have exited, reused by new threads so
+// that short-lived threads do not add a buffer each.
+vector<TraceBuffer*> free_buffers;
+int registry_buffer_size = 65536;
+
+// The buffer of each thread that has recorded a span since it started.
+std::map<std::thread::id, TraceBuffer*> thread_buffers;
+
+TraceBuffer* ThreadBuffer() {
+  const std::thread::id id = std::this_thread::get_id();
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::map<std::thread::id, TraceBuffer*>::iterator it =
+      thread_buffers.find(id);
+  if (it != thread_buffers.end()) {
+    return it->second;
+  }
+  // Most recently freed first, as its events are likely allocated.
+  for (int i = free_buffers.size() - 1; i >= 0; --i) {
+    if (free_buffers[i]->capacity == registry_buffer_size) {
+      TraceBuffer* buffer = free_buffers[i];
+      free_buffers.erase(free_buffers.begin() + i);
+      thread_buffers[id] = buffer;
+      return buffer;
+    }
+  }
+  shared_ptr<TraceBuffer> buffer(new TraceBuffer());
+  buffer->tid = registry.size();
+  buffer->capacity = registry_buffer_size;
+  buffer->next = 0;
+  registry.push_back(buffer);
+  thread_buffers[id] = buffer.get();
+  return buffer.get();
+}
+
+void WriteJsonString(FILE* file, const char* str) {
+  fputc('"', file);
+  for (const char* c = str; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+      fputc(*c, file);
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    } else {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_(false);
+
+void Tracer::Enable() {
+  NowMicros();  // Starts the clock.
+  enabled_.store(true);
+}
+
+void Tracer::Disable() {
+  enabled_.store(false);
+}
+
+void Tracer::set_buffer_size(int buffer_size) {
+  CHECK_GT(buffer_size, 0);
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  registry_buffer_size = buffer_size;
+}
+
+int Tracer::buffer_size() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  return registry_buffer_size;
+}
+
+void Tracer::ReleaseThreadBuffer() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::map<std::thread::id, TraceBuffer*>::iterator it =
+      thread_buffers.find(std::this_thread::get_id());
+  if (it != thread_buffers.end()) {
+    free_buffers.push_back(it->second);
+    thread_buffers.erase(it);
+  }
+}
+
+int64_t Tracer::NowMicros() {
+  static const int64_t start = MonotonicMicros();
+  return MonotonicMicros() - start;
+}
+
+void Tracer::Record(const char* name, const char* category,
+    int64_t begin_us, int64_t end_us) {
+  TraceBuffer* buffer = ThreadBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  if (buffer->events.size() < buffer->capacity) {
+    buffer->events.push_back(TraceEvent());
+  }
+  TraceEvent& event = buffer->events[buffer->next % buffer->events.size()];
+  strncpy(event.name, name, kMaxNameLength);
+  event.name[kMaxNameLength] = '\0';
+  event.category = category;
+  event.begin_us = begin_us;
+  event.end_us = end_us;
+  ++buffer->next;
+}
+
+int Tracer::num_events() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  int count = 0;
+  for (int i = 0; i < registry.size(); ++i) {
+    std::lock_guard<std::mutex> buffer_lock(registry[i]->mutex);
+    count += std::min<uint64_t>(registry[i]->next,
+                                registry[i]->events.size());
+  }
+  return count;
+}
+
+bool Tracer::WriteChromeTrace(const string& filename) {
+  FILE* file = fopen(filename.c_str(), "w");
+  if (!file) {
+    LOG(ERROR) << "Cannot write the trace to " << filename;
+    return false;
+  }
+  fprintf(file, "{\"traceEvents\":[");
+  bool first = true;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (int i = 0; i < registry.size(); ++i) {
+    TraceBuffer* buffer = registry[i].get();
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    const uint64_t size = buffer->events.size();
+    const uint64_t begin = buffer->next > size ? buffer->next - size : 0;
+    for (uint64_t e = begin; e < buffer->next; ++e) {
+      const TraceEvent& event = buffer->events[e % size];
+      fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+      WriteJsonString(file, event.name);
+      fprintf(file, ",\"cat\":");
+      WriteJsonString(file, event.category);
+      fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%lld,"
+          "\"dur\":%lld}", buffer->tid,
+          static_cast<long long>(event.begin_us),  // NOLINT(runtime/int)
+          static_cast<long long>(  // NOLINT(runtime/int)
+              event.end_us - event.begin_us));
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  const bool ok = !ferror(file);
+  fclose(file);
+  if (!ok) {
+    LOG(ERROR) << "Cannot write the trace to " << filename;
+  }
+  return ok;
+}
+
+void Tracer::Clear() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (int i = 0; i < registry.size(); ++i) {
+    std::lock_guard<std::mutex> buffer_lock(registry[i]->mutex);
+    registry[i]->events.clear();
+    registry[i]->next = 0;
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,96 @@
+// Copyright 2014 BVLC and contributors.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/trace.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+namespace caffe {
+
+WorkerPool::WorkerPool(const int num_workers)
+    : num_workers_(num_workers),
+      generation_(0),
+      num_pending_(0),
+      stop_(false),
+      num_items_(0),
+      seed_(0),
+      item_fn_(NULL) {
+  CHECK_GT(num_workers_, 0) << "num_workers must be positive.";
+  for (int i = 0; i < num_workers_; ++i) {
+    rngs_.push_back(shared_ptr<rng_t>(new rng_t()));
+  }
+  for (int i = 1; i < num_workers_; ++i) {
+    threads_.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_ready_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+}
+
+void WorkerPool::Run(const int num_items, const unsigned int seed,
+    const ItemFunction& item_fn) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_items_ = num_items;
+    seed_ = seed;
+    item_fn_ = &item_fn;
+    num_pending_ = threads_.size();
+    ++generation_;
+  }
+  work_ready_.notify_all();
+  RunRange(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_pending_ > 0) {
+    work_done_.wait(lock);
+  }
+  item_fn_ = NULL;
+}
+
+void WorkerPool::WorkerLoop(const int worker_id) {
+  TraceThread trace_thread;
+  unsigned int seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stop_ && generation_ == seen_generation) {
+        work_ready_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+    RunRange(worker_id);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --num_pending_;
+    }
+    work_done_.notify_one();
+  }
+}
+
+void WorkerPool::RunRange(const int worker_id) {
+  // The batch fields are only written by Run while every worker is idle.
+  const int begin = static_cast<int64_t>(num_items_) * worker_id
+      / num_workers_;
+  const int end = static_cast<int64_t>(num_items_) * (worker_id + 1)
+      / num_workers_;
+  rng_t* rng = rngs_[worker_id].get();
+  for (int item_id = begin; item_id < end; ++item_id) {
+    rng->seed(static_cast<rng_t::result_type>(seed_ + item_id));
+    (*item_fn_)(item_id, rng);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,101 @@
+// Copyright 2014 BVLC and contributors.
+// Builds a table of binary codes from extracted features and answers
+// k-nearest-neighbor queries in Hamming distance.
+// Usage:
+//    binary_code_search [--threshold=0] build FEATURE_MATRIX CODE_TABLE
+//    binary_code_search [--threshold=0] [--k=10] [--threads=N]
+//        query CODE_TABLE QUERY_MATRIX
+// The feature matrices are written by extract_features --format=matrix. A
+// feature above the threshold sets its bit; use the same threshold for the
+// table and the queries. Each query prints its k nearest rows of the table
+// as index:distance pairs, nearest first.
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/binary_codes.hpp"
+#include "caffe/util/command_line.hpp"
+#include "caffe/util/feature_matrix.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::pair;
+using std::string;
+using std::vector;
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  CommandLineFlags flags(&argc, argv);
+  const float threshold = flags.GetDouble("threshold", 0.);
+  const int k = flags.GetInt("k", 10);
+  const int num_threads = flags.GetInt("threads",
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  flags.CheckAllUsed();
+  if (argc != 4 || (string(argv[1]) != "build" &&
+                    string(argv[1]) != "query")) {
+    LOG(ERROR) << "Usage:\n"
+        "    binary_code_search [--threshold=0] build FEATURE_MATRIX"
+        " CODE_TABLE\n"
+        "    binary_code_search [--threshold=0] [--k=10] [--threads=N]"
+        " query CODE_TABLE QUERY_MATRIX";
+    return 1;
+  }
+  CHECK_GT(k, 0);
+  CHECK_GT(num_threads, 0);
+
+  if (string(argv[1]) == "build") {
+    uint64_t rows;
+    int cols;
+    vector<float> features;
+    CHECK(ReadFeatureMatrix(argv[2], &rows, &cols, &features));
+    BinaryCodeTable table;
+    table.Binarize(rows ? &features[0] : NULL, rows, cols, threshold);
+    LOG(INFO) << "Writing " << table.num_codes() << " codes of "
+        << table.num_bits() << " bits to " << argv[3];
+    table.Write(argv[3]);
+    return 0;
+  }
+
+  BinaryCodeTable table;
+  CHECK(table.Read(argv[2]));
+  LOG(INFO) << "Loaded " << table.num_codes() << " codes of "
+      << table.num_bits() << " bits";
+  uint64_t num_queries;
+  int cols;
+  vector<float> queries;
+  CHECK(ReadFeatureMatrix(argv[3], &num_queries, &cols, &queries));
+  CHECK_EQ(cols, table.num_bits()) << "The queries have " << cols
+      << " features, the codes " << table.num_bits() << " bits";
+  WorkerPool pool(num_threads);
+  vector<uint64_t> code;
+  vector<pair<int, int> > results;
+  Timer timer;
+  float total_ms = 0;
+  for (int q = 0; q < num_queries; ++q) {
+    table.BinarizeQuery(&queries[static_cast<size_t>(q) * cols], threshold,
+        &code);
+    timer.Start();
+    table.Search(&code[0], k, &pool, &results);
+    total_ms += timer.MilliSeconds();
+    printf("%d:", q);
+    for (int i = 0; i < results.size(); ++i) {
+      printf(" %d:%d", results[i].second, results[i].first);
+    }
+    printf("\n");
+  }
+  if (num_queries > 0) {
+    LOG(INFO) << "Searched " << num_queries << " queries with "
+        << num_threads << " threads, " << total_ms / num_queries
+        << " ms per query.";
+  }
+  return 0;
+}
@@ -1,86 +1,205 @@
 // Copyright 2014 BVLC and contributors.
+// Computes the mean image of a leveldb or lmdb of Datums.
+// Usage:
+//    compute_image_mean [FLAGS] input_db output_file [leveldb/lmdb]
+// FLAGS:
+//   --threads=N             records decoded in parallel (default: all cores)
+//   --max_images=N          average up to N records spread evenly over
+//                           the key range instead of all of them
+//   --channel_mean_file=F   also write the per-channel mean, a 1xCx1x1 blob
+// The key range between the first and the last key is split into one
+// contiguous range per thread, each summed in double precision on its own
+// cursor. Sampling seeks to the records it reads, so that it does not read
+// the whole database.
 
 #include <glog/logging.h>
-#include <leveldb/db.h>
 #include <stdint.h>
 
 #include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/command_line.hpp"
+#include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 using caffe::Datum;
 using caffe::BlobProto;
+using caffe::CommandLineFlags;
+using caffe::DecodeDatum;
+using caffe::WorkerPool;
+using caffe::rng_t;
+using caffe::shared_ptr;
 using std::max;
+using std::string;
+using std::vector;
+namespace db = caffe::db;
+
+// Parses the cursor's record into datum, decoding it if needed, and adds its
+// values to sum.
+void AccumulateRecord(const db::Cursor& cursor, Datum* datum,
+    vector<double>* sum) {
+  datum->ParseFromArray(cursor.value_data(), cursor.value_size());
+  if (datum->encoded()) {
+    CHECK(DecodeDatum(0, 0, datum));
+  }
+  const string& data = datum->data();
+  const int size_in_datum = max<int>(data.size(), datum->float_data_size());
+  CHECK_EQ(size_in_datum, sum->size()) << "Incorrect data field size " <<
+      size_in_datum;
+  double* sum_data = &(*sum)[0];
+  if (data.size() != 0) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    for (int i = 0; i < size_in_datum; ++i) {
+      sum_data[i] += bytes[i];
+    }
+  } else {
+    for (int i = 0; i < size_in_datum; ++i) {
+      sum_data[i] += datum->float_data(i);
+    }
+  }
+}
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
-  if (argc != 3) {
-    LOG(ERROR) << "Usage: compute_image_mean input_leveldb output_file";
+  CommandLineFlags flags(&argc, argv);
+  if (argc < 3 || argc > 4) {
+    LOG(ERROR) << "Usage: compute_image_mean [--threads=N] [--max_images=N]"
+        " [--channel_mean_file=F] input_db output_file [leveldb/lmdb]";
     return 1;
   }
+  const int num_threads = flags.GetInt("threads",
+      max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  const int max_images = flags.GetInt("max_images", 0);
+  const string channel_mean_file = flags.GetString("channel_mean_file", "");
+  flags.CheckAllUsed();
+  CHECK_GT(num_threads, 0);
+  CHECK_GE(max_images, 0);
 
-  leveldb::DB* db;
-  leveldb::Options options;
-  options.create_if_missing = false;
-
-  LOG(INFO) << "Opening leveldb " << argv[1];
-  leveldb::Status status = leveldb::DB::Open(
-      options, argv[1], &db);
-  CHECK(status.ok()) << "Failed to open leveldb " << argv[1];
-
-  leveldb::ReadOptions read_options;
-  read_options.fill_cache = false;
-  leveldb::Iterator* it = db->NewIterator(read_options);
-  it->SeekToFirst();
+  const string db_backend = (argc == 4) ? argv[3] : "leveldb";
+  shared_ptr<db::DB> db(db::GetDB(db_backend));
+  db->Open(argv[1], db::READ);
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  CHECK(cursor->valid()) << "Empty database " << argv[1];
   Datum datum;
+  datum.ParseFromArray(cursor->value_data(), cursor->value_size());
+  if (datum.encoded()) {
+    CHECK(DecodeDatum(0, 0, &datum));
+  }
   BlobProto sum_blob;
-  int count = 0;
-  datum.ParseFromString(it->value().ToString());
   sum_blob.set_num(1);
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
-  const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+  const int data_size = max<int>(datum.data().size(),
+                                 datum.float_data_size());
+
+  // Neither path lists the keys, as that would read every record. Sampling
+  // seeks to keys spread evenly between the first and the last, in key
+  // order, and the full pass splits that key range into one range per thread,
+  // each read from its start key up to the next range's.
+  const bool sample = max_images > 0;
+  const string first_key = cursor->key();
+  cursor->SeekToLast();
+  const string last_key = cursor->key();
+  vector<string> keys;
+  int num_ranges = num_threads;
+  if (sample) {
+    for (int i = 0; i < max_images; ++i) {
+      keys.push_back(db::InterpolateKey(first_key, last_key,
+          max_images > 1 ? static_cast<double>(i) / (max_images - 1) : 0.));
+    }
+    num_ranges = std::min(num_threads, max_images);
+    LOG(INFO) << "Sampling up to " << max_images << " records";
+  } else {
+    keys.push_back(first_key);
+    for (int r = 1; r < num_ranges; ++r) {
+      keys.push_back(db::InterpolateKey(first_key, last_key,
+          static_cast<double>(r) / num_ranges));
+    }
   }
-  LOG(INFO) << "Starting Iteration";
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
-    // just a dummy operation
-    datum.ParseFromString(it->value().ToString());
-    const string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(), datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
+  // Cursors are opened here, as LMDB does not allow it concurrently.
+  vector<shared_ptr<db::Cursor> > cursors(num_ranges);
+  vector<vector<double> > sums(num_ranges);
+  for (int r = 0; r < num_ranges; ++r) {
+    cursors[r].reset(db->NewCursor());
+    sums[r].assign(data_size, 0.);
+  }
+  std::atomic<int> count(0);
+  LOG(INFO) << "Starting Iteration with " << num_ranges << " threads";
+  WorkerPool pool(num_ranges);
+  pool.Run(num_ranges, 0, [&](int r, rng_t*) {
+    db::Cursor* range_cursor = cursors[r].get();
+    Datum range_datum;
+    if (!sample) {
+      const bool last_range = r + 1 == num_ranges;
+      for (range_cursor->Seek(keys[r]); range_cursor->valid() &&
+           (last_range || range_cursor->key() < keys[r + 1]);
+           range_cursor->Next()) {
+        AccumulateRecord(*range_cursor, &range_datum, &sums[r]);
+        const int processed = ++count;
+        if (processed % 10000 == 0) {
+          LOG(ERROR) << "Processed " << processed << " files.";
+        }
       }
+      return;
     }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(ERROR) << "Processed " << count << " files.";
+    const int begin = static_cast<int64_t>(r) * keys.size() / num_ranges;
+    const int end = static_cast<int64_t>(r + 1) * keys.size() / num_ranges;
+    for (int i = begin; i < end; ++i) {
+      CHECK(range_cursor->Seek(keys[i]));
+      // Seeking to the next key would find the same record, where the keys
+      // are closer together than the records.
+      if (i + 1 < static_cast<int>(keys.size()) &&
+          range_cursor->key() >= keys[i + 1]) {
+        continue;
+      }
+      AccumulateRecord(*range_cursor, &range_datum, &sums[r]);
+      const int processed = ++count;
+      if (processed % 10000 == 0) {
+        LOG(ERROR) << "Processed " << processed << " files.";
+      }
     }
-  }
+  });
   if (count % 10000 != 0) {
     LOG(ERROR) << "Processed " << count << " files.";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  for (int r = 1; r < num_ranges; ++r) {
+    for (int i = 0; i < data_size; ++i) {
+      sums[0][i] += sums[r][i];
+    }
+  }
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sums[0][i] / count);
   }
   // Write to disk
   LOG(INFO) << "Write to " << argv[2];
   WriteProtoToBinaryFile(sum_blob, argv[2]);
 
-  delete db;
+  const int channels = sum_blob.channels();
+  const int dim = data_size / channels;
+  BlobProto channel_blob;
+  channel_blob.set_num(1);
+  channel_blob.set_channels(channels);
+  channel_blob.set_height(1);
+  channel_blob.set_width(1);
+  for (int c = 0; c < channels; ++c) {
+    double channel_sum = 0;
+    for (int i = 0; i < dim; ++i) {
+      channel_sum += sums[0][c * dim + i];
+    }
+    const double mean = channel_sum / (static_cast<double>(count) * dim);
+    LOG(INFO) << "Mean of channel " << c << ": " << mean;
+    channel_blob.add_data(mean);
+  }
+  if (!channel_mean_file.empty()) {
+    LOG(INFO) << "Write to " << channel_mean_file;
+    WriteProtoToBinaryFile(channel_blob, channel_mean_file);
+  }
   return 0;
 }
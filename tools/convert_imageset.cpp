@@ -1,44 +1,90 @@
 // Copyright 2014 BVLC and contributors.
-// This program converts a set of images to a leveldb by storing them as Datum
-// proto buffers.
+// This program converts a set of images to a leveldb or lmdb by storing them
+// as Datum proto buffers.
 // Usage:
-//    convert_imageset ROOTFOLDER/ LISTFILE DB_NAME [0/1]
+//    convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME [0/1]
+//        [leveldb/lmdb] [0/1]
 // where ROOTFOLDER is the root folder that holds all the images, and LISTFILE
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
-// if the last argument is 1, a random shuffle will be carried out before we
-// process the file lines.
+// if the fourth argument is 1, a random shuffle will be carried out before we
+// process the file lines. The fifth argument picks the database backend, and
+// defaults to leveldb. If the last argument is 1, the image files are stored
+// as they are, still encoded, and decoded by the DataLayer; this keeps the
+// database about as small as the images.
+// FLAGS:
+//   --threads=N          images decoded in parallel (default: all cores)
+//   --resize_height=H    size of the stored raw images; 0 keeps the
+//   --resize_width=W     original size (default 32x32)
+//   --shards=N           write DB_NAME_0 ... DB_NAME_{N-1}, line i going to
+//                        shard i % N (default 1, a single DB_NAME)
+//   --batch_size=N       images per transaction (default 1000)
+// The keys are the same whatever the number of threads: the images are
+// decoded in parallel a batch at a time, while the previous batch is written
+// in list order.
 
 #include <glog/logging.h>
-#include <leveldb/db.h>
-#include <leveldb/write_batch.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/command_line.hpp"
+#include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
 using std::string;
+using std::vector;
+
+// The serialized records of lines [begin, end); an empty value marks an
+// image that could not be read.
+struct ConvertBatch {
+  int begin;
+  int end;
+  vector<string> values;
+  vector<int> data_sizes;
+};
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
-  if (argc < 4 || argc > 5) {
-    printf("Convert a set of images to the leveldb format used\n"
+  CommandLineFlags flags(&argc, argv);
+  if (argc < 4 || argc > 7) {
+    printf("Convert a set of images to the leveldb or lmdb format used\n"
         "as input for Caffe.\n"
         "Usage:\n"
-        "    convert_imageset ROOTFOLDER/ LISTFILE DB_NAME"
-        " RANDOM_SHUFFLE_DATA[0 or 1]\n"
+        "    convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME"
+        " RANDOM_SHUFFLE_DATA[0 or 1] DB_BACKEND[leveldb or lmdb]"
+        " ENCODED[0 or 1]\n"
+        "Flags: --threads=N --resize_height=H --resize_width=W"
+        " --shards=N --batch_size=N\n"
         "The ImageNet dataset for the training demo is at\n"
         "    http://www.image-net.org/download-images\n");
     return 1;
   }
+  const int num_threads = flags.GetInt("threads",
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  const bool resize = flags.Has("resize_height") || flags.Has("resize_width");
+  const int resize_height = flags.GetInt("resize_height", 0);
+  const int resize_width = flags.GetInt("resize_width", 0);
+  const int num_shards = flags.GetInt("shards", 1);
+  const int batch_size = flags.GetInt("batch_size", 1000);
+  flags.CheckAllUsed();
+  CHECK_GT(num_threads, 0);
+  CHECK_GT(num_shards, 0);
+  CHECK_GT(batch_size, 0);
+
   std::ifstream infile(argv[2]);
   std::vector<std::pair<string, int> > lines;
   string filename;
@@ -46,66 +92,119 @@ int main(int argc, char** argv) {
   while (infile >> filename >> label) {
     lines.push_back(std::make_pair(filename, label));
   }
-  if (argc == 5 && argv[4][0] == '1') {
+  if (argc >= 5 && argv[4][0] == '1') {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
     std::random_shuffle(lines.begin(), lines.end());
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
 
-  leveldb::DB* db;
-  leveldb::Options options;
-  options.error_if_exists = true;
-  options.create_if_missing = true;
-  options.write_buffer_size = 268435456;
-  LOG(INFO) << "Opening leveldb " << argv[3];
-  leveldb::Status status = leveldb::DB::Open(
-      options, argv[3], &db);
-  CHECK(status.ok()) << "Failed to open leveldb " << argv[3];
+  const string db_backend = (argc >= 6) ? argv[5] : "leveldb";
+  const bool encoded = argc >= 7 && argv[6][0] == '1';
+  if (encoded) {
+    LOG(INFO) << "Storing the encoded image files";
+    CHECK(!resize) << "Encoded images are stored as they are and cannot be"
+        " resized; the DataLayer can resize them when decoding.";
+  }
+  vector<shared_ptr<db::DB> > dbs(num_shards);
+  vector<shared_ptr<db::Transaction> > txns(num_shards);
+  for (int shard = 0; shard < num_shards; ++shard) {
+    string db_name(argv[3]);
+    if (num_shards > 1) {
+      char suffix[32];
+      snprintf(suffix, sizeof(suffix), "_%d", shard);
+      db_name += suffix;
+    }
+    dbs[shard].reset(db::GetDB(db_backend));
+    dbs[shard]->Open(db_name, db::NEW);
+    txns[shard].reset(dbs[shard]->NewTransaction());
+  }
 
   string root_folder(argv[1]);
   root_folder = "";
-  Datum datum;
+  LOG(INFO) << "Decoding with " << num_threads << " threads";
+  WorkerPool pool(num_threads);
+  // One batch is written while the next ones are decoded.
+  const int kNumBatches = 3;
+  vector<ConvertBatch> batches(kNumBatches);
+  BlockingQueue<int> free_batches;
+  BlockingQueue<int> full_batches;
+  for (int i = 0; i < kNumBatches; ++i) {
+    free_batches.Push(i);
+  }
+
+  Timer timer;
+  timer.Start();
+  float seconds = 0;
   int count = 0;
-  const int kMaxKeyLength = 256;
-  char key_cstr[kMaxKeyLength];
-  leveldb::WriteBatch* batch = new leveldb::WriteBatch();
-  int data_size;
-  bool data_size_initialized = false;
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    if (!ReadImageToDatum(root_folder + lines[line_id].first,
-                          lines[line_id].second, &datum)) {
-      continue;
-    }
-    if (!data_size_initialized) {
-      data_size = datum.channels() * datum.height() * datum.width();
-      data_size_initialized = true;
-    } else {
-      const string& data = datum.data();
-      CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-          << data.size();
-    }
-    // sequential
-    snprintf(key_cstr, kMaxKeyLength, "%08d_%s", line_id,
-        lines[line_id].first.c_str());
-    string value;
-    // get the value
-    datum.SerializeToString(&value);
-    batch->Put(string(key_cstr), value);
-    if (++count % 1000 == 0) {
-      db->Write(leveldb::WriteOptions(), batch);
-      LOG(ERROR) << "Processed " << count << " files.";
-      delete batch;
-      batch = new leveldb::WriteBatch();
+  std::thread writer([&]() {
+    const int kMaxKeyLength = 256;
+    char key_cstr[kMaxKeyLength];
+    int data_size;
+    bool data_size_initialized = false;
+    for (int slot = full_batches.Pop(); slot >= 0; slot = full_batches.Pop()) {
+      ConvertBatch& batch = batches[slot];
+      for (int line_id = batch.begin; line_id < batch.end; ++line_id) {
+        const int i = line_id - batch.begin;
+        if (batch.values[i].empty()) {
+          continue;
+        }
+        // Encoded files differ in size, so there is nothing to check.
+        if (!encoded) {
+          if (!data_size_initialized) {
+            data_size = batch.data_sizes[i];
+            data_size_initialized = true;
+          } else {
+            CHECK_EQ(batch.data_sizes[i], data_size)
+                << "Incorrect data field size " << batch.data_sizes[i];
+          }
+        }
+        // sequential
+        snprintf(key_cstr, kMaxKeyLength, "%08d_%s", line_id,
+            lines[line_id].first.c_str());
+        txns[line_id % num_shards]->Put(string(key_cstr), batch.values[i]);
+        ++count;
+      }
+      for (int shard = 0; shard < num_shards; ++shard) {
+        txns[shard]->Commit();
+      }
+      free_batches.Push(slot);
+      seconds += timer.Seconds();
+      timer.Start();
+      LOG(ERROR) << "Processed " << count << " files, "
+          << count / std::max(seconds, 0.001f) << " images/sec.";
     }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    db->Write(leveldb::WriteOptions(), batch);
-    LOG(ERROR) << "Processed " << count << " files.";
-  }
+  });
 
-  delete batch;
-  delete db;
+  for (int begin = 0; begin < lines.size(); begin += batch_size) {
+    const int slot = free_batches.Pop();
+    ConvertBatch& batch = batches[slot];
+    batch.begin = begin;
+    batch.end = std::min(begin + batch_size, static_cast<int>(lines.size()));
+    batch.values.resize(batch.end - batch.begin);
+    batch.data_sizes.resize(batch.end - batch.begin);
+    pool.Run(batch.end - batch.begin, 0, [&](int item_id, rng_t*) {
+      const int line_id = batch.begin + item_id;
+      const string path = root_folder + lines[line_id].first;
+      Datum datum;
+      bool ok;
+      if (encoded) {
+        ok = ReadFileToDatum(path, lines[line_id].second, &datum);
+      } else if (resize) {
+        ok = ReadImageToDatum(path, lines[line_id].second, resize_height,
+            resize_width, &datum);
+      } else {
+        ok = ReadImageToDatum(path, lines[line_id].second, &datum);
+      }
+      batch.values[item_id].clear();
+      if (ok) {
+        batch.data_sizes[item_id] = datum.data().size();
+        datum.SerializeToString(&batch.values[item_id]);
+      }
+    });
+    full_batches.Push(slot);
+  }
+  full_batches.Push(-1);
+  writer.join();
   return 0;
 }
@@ -0,0 +1,116 @@
+// Copyright 2014 BVLC and contributors.
+//
+// Compares the throughput of the shared data transform against the scalar
+// loops the data layers used before it.
+// Usage:
+//    data_transform_benchmark [iterations=200] [crop_size=227]
+
+#include <stdint.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/data_transform.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::string;
+using std::vector;
+
+// The per-pixel loop formerly copied into every data layer.
+void ScalarCrop(const int channels, const int height, const int width,
+    const int h_off, const int w_off, const int crop_size, const bool mirror,
+    const uint8_t* data, const float* mean, const float scale,
+    float* top_data) {
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        int top_index = (c * crop_size + h) * crop_size
+            + (mirror ? crop_size - 1 - w : w);
+        int data_index = (c * height + h + h_off) * width + w + w_off;
+        float datum_element = static_cast<float>(data[data_index]);
+        top_data[top_index] = (datum_element - mean[data_index]) * scale;
+      }
+    }
+  }
+}
+
+void ScalarFull(const int size, const uint8_t* data, const float* mean,
+    const float scale, float* top_data) {
+  for (int j = 0; j < size; ++j) {
+    float datum_element = static_cast<float>(data[j]);
+    top_data[j] = (datum_element - mean[j]) * scale;
+  }
+}
+
+void Report(const string& name, const int iterations, const int pixels,
+    const float scalar_ms, const float simd_ms) {
+  const double total = static_cast<double>(pixels) * iterations;
+  LOG(ERROR) << name << "\tscalar: " << total / scalar_ms / 1000
+      << " Mpixels/s\ttransform: " << total / simd_ms / 1000
+      << " Mpixels/s\tspeedup: " << scalar_ms / simd_ms << "x";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc > 3) {
+    LOG(ERROR) << "data_transform_benchmark [iterations=200] [crop_size=227]";
+    return 1;
+  }
+  const int iterations = (argc >= 2) ? atoi(argv[1]) : 200;
+  const int crop_size = (argc >= 3) ? atoi(argv[2]) : 227;
+  const int channels = 3;
+  const int height = 256;
+  const int width = 256;
+  const int size = channels * height * width;
+  CHECK_GT(iterations, 0);
+  CHECK_GT(crop_size, 0);
+  CHECK_LE(crop_size, height);
+
+  Caffe::set_mode(Caffe::CPU);
+  vector<uint8_t> data(size);
+  vector<float> mean(size);
+  for (int i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(caffe_rng_rand() % 256);
+    mean[i] = static_cast<float>(caffe_rng_rand() % 256);
+  }
+  vector<float> top(size);
+  const float scale = 0.00390625;
+  const int h_off = (height - crop_size) / 2;
+  const int w_off = (width - crop_size) / 2;
+  const int crop_pixels = channels * crop_size * crop_size;
+
+  Timer timer;
+  for (int mirror = 0; mirror < 2; ++mirror) {
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      ScalarCrop(channels, height, width, h_off, w_off, crop_size, mirror,
+          &data[0], &mean[0], scale, &top[0]);
+    }
+    const float scalar_ms = timer.MilliSeconds();
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      caffe_transform_crop(channels, height, width, h_off, w_off, crop_size,
+          crop_size, mirror, &data[0], &mean[0], scale, &top[0]);
+    }
+    const float simd_ms = timer.MilliSeconds();
+    Report(mirror ? "mirrored crop" : "crop", iterations, crop_pixels,
+        scalar_ms, simd_ms);
+  }
+
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    ScalarFull(size, &data[0], &mean[0], scale, &top[0]);
+  }
+  const float scalar_ms = timer.MilliSeconds();
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    caffe_transform(size, &data[0], &mean[0], scale, &top[0]);
+  }
+  const float simd_ms = timer.MilliSeconds();
+  Report("full image", iterations, size, scalar_ms, simd_ms);
+  return 0;
+}
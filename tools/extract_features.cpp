@@ -1,11 +1,11 @@
 // Copyright 2014 BVLC and contributors.
 
 #include <stdio.h>  // for snprintf
+#include <string.h>
 #include <cuda_runtime.h>
 #include <google/protobuf/text_format.h>
-#include <leveldb/db.h>
-#include <leveldb/write_batch.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -13,10 +13,26 @@
 #include "caffe/net.hpp"
 #include "caffe/vision_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/command_line.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/feature_matrix.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
+vector<string> SplitCommaList(const string& list) {
+  vector<string> items;
+  size_t begin = 0;
+  for (size_t end; (end = list.find(',', begin)) != string::npos;
+       begin = end + 1) {
+    items.push_back(list.substr(begin, end - begin));
+  }
+  items.push_back(list.substr(begin));
+  return items;
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -27,16 +43,28 @@ int main(int argc, char** argv) {
 
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv) {
+  CommandLineFlags flags(&argc, argv);
+  const string format = flags.GetString("format", "datum");
+  const string db_backend = flags.GetString("backend", "leveldb");
+  flags.CheckAllUsed();
   const int num_required_args = 6;
   if (argc < num_required_args) {
     LOG(ERROR)<<
     "This program takes in a trained network and an input data layer, and then"
     " extract features of the input data produced by the net.\n"
-    "Usage: demo_extract_features  pretrained_net_param"
-    "  feature_extraction_proto_file  extract_feature_blob_name"
-    "  save_feature_leveldb_name  num_mini_batches  [CPU/GPU]  [DEVICE_ID=0]";
+    "Usage: demo_extract_features  [--format=datum/matrix]"
+    "  [--backend=leveldb/lmdb]  pretrained_net_param"
+    "  feature_extraction_proto_file  extract_feature_blob_name1[,name2,...]"
+    "  save_feature_name1[,name2,...]  num_mini_batches  [CPU/GPU]"
+    "  [DEVICE_ID=0]\n"
+    "With --format=datum (the default) each blob is saved to a database of"
+    " Datums keyed by image index; with --format=matrix to a float32 matrix"
+    " file with one row per image (see caffe/util/feature_matrix.hpp).";
     return 1;
   }
+  CHECK(format == "datum" || format == "matrix")
+      << "Unknown --format " << format;
+  const bool matrix_format = format == "matrix";
   int arg_pos = num_required_args;
 
   arg_pos = num_required_args;
@@ -87,79 +115,132 @@ int feature_extraction_pipeline(int argc, char** argv) {
    }
    */
   string feature_extraction_proto(argv[++arg_pos]);
+  NetParameter feature_extraction_param;
+  ReadNetParamsFromTextFileOrDie(feature_extraction_proto,
+      &feature_extraction_param);
+  feature_extraction_param.set_inference_only(true);
   boost::shared_ptr<Net<Dtype> > feature_extraction_net(
-      new Net<Dtype>(feature_extraction_proto));
+      new Net<Dtype>(feature_extraction_param));
   feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
 
-  string extract_feature_blob_name(argv[++arg_pos]);
-  CHECK(feature_extraction_net->has_blob(extract_feature_blob_name))
-      << "Unknown feature blob name " << extract_feature_blob_name
-      << " in the network " << feature_extraction_proto;
-
-  string save_feature_leveldb_name(argv[++arg_pos]);
-  leveldb::DB* db;
-  leveldb::Options options;
-  options.error_if_exists = true;
-  options.create_if_missing = true;
-  options.write_buffer_size = 268435456;
-  LOG(INFO)<< "Opening leveldb " << save_feature_leveldb_name;
-  leveldb::Status status = leveldb::DB::Open(options,
-                                             save_feature_leveldb_name.c_str(),
-                                             &db);
-  CHECK(status.ok()) << "Failed to open leveldb " << save_feature_leveldb_name;
+  // Blob names and outputs are comma separated lists of equal length.
+  vector<string> blob_names = SplitCommaList(argv[++arg_pos]);
+  vector<string> output_names = SplitCommaList(argv[++arg_pos]);
+  CHECK_EQ(blob_names.size(), output_names.size())
+      << "Give one output for every feature blob";
+  const int num_blobs = blob_names.size();
+  vector<shared_ptr<Blob<Dtype> > > feature_blobs(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) {
+    CHECK(feature_extraction_net->has_blob(blob_names[i]))
+        << "Unknown feature blob name " << blob_names[i]
+        << " in the network " << feature_extraction_proto;
+    feature_blobs[i] = feature_extraction_net->blob_by_name(blob_names[i]);
+  }
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
+  // One mini-batch is written while the next one is forwarded.
+  const int kNumSlots = 2;
+  vector<vector<vector<float> > > slots(kNumSlots,
+      vector<vector<float> >(num_blobs));
+  BlockingQueue<int> free_slots;
+  BlockingQueue<int> full_slots;
+  for (int i = 0; i < kNumSlots; ++i) {
+    free_slots.Push(i);
+  }
+  vector<shared_ptr<db::DB> > dbs(num_blobs);
+  vector<shared_ptr<db::Transaction> > txns(num_blobs);
+  vector<shared_ptr<FeatureMatrixWriter> > matrices(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) {
+    const int dim_features = feature_blobs[i]->count() /
+        feature_blobs[i]->num();
+    if (matrix_format) {
+      LOG(INFO) << "Writing " << blob_names[i] << " to matrix "
+          << output_names[i];
+      matrices[i].reset(new FeatureMatrixWriter(output_names[i],
+          dim_features));
+    } else {
+      dbs[i].reset(db::GetDB(db_backend));
+      dbs[i]->Open(output_names[i], db::NEW);
+      txns[i].reset(dbs[i]->NewTransaction());
+    }
+  }
+
   LOG(ERROR)<< "Extacting Features";
 
-  Datum datum;
-  leveldb::WriteBatch* batch = new leveldb::WriteBatch();
-  const int kMaxKeyStrLength = 100;
-  char key_str[kMaxKeyStrLength];
-  int num_bytes_of_binary_code = sizeof(Dtype);
-  vector<Blob<float>*> input_vec;
   int image_index = 0;
-  for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
-    feature_extraction_net->Forward(input_vec);
-    const boost::shared_ptr<Blob<Dtype> > feature_blob = feature_extraction_net
-        ->blob_by_name(extract_feature_blob_name);
-    int num_features = feature_blob->num();
-    int dim_features = feature_blob->count() / num_features;
-    Dtype* feature_blob_data;
-    for (int n = 0; n < num_features; ++n) {
-      datum.set_height(dim_features);
-      datum.set_width(1);
-      datum.set_channels(1);
-      datum.clear_data();
-      datum.clear_float_data();
-      feature_blob_data = feature_blob->mutable_cpu_data() +
-          feature_blob->offset(n);
-      for (int d = 0; d < dim_features; ++d) {
-        datum.add_float_data(feature_blob_data[d]);
+  std::thread writer([&]() {
+    Datum datum;
+    const int kMaxKeyStrLength = 100;
+    char key_str[kMaxKeyStrLength];
+    int pending = 0;
+    for (int slot = full_slots.Pop(); slot >= 0; slot = full_slots.Pop()) {
+      int num_features = 0;
+      for (int i = 0; i < num_blobs; ++i) {
+        const vector<float>& features = slots[slot][i];
+        const int dim_features = feature_blobs[i]->count() /
+            feature_blobs[i]->num();
+        num_features = features.size() / dim_features;
+        if (matrix_format) {
+          if (num_features > 0) {
+            matrices[i]->AppendRows(&features[0], num_features);
+          }
+          continue;
+        }
+        datum.set_height(dim_features);
+        datum.set_width(1);
+        datum.set_channels(1);
+        datum.clear_data();
+        for (int n = 0; n < num_features; ++n) {
+          // Copy the row in one go rather than one add_float_data at a time.
+          datum.mutable_float_data()->Resize(dim_features, 0);
+          memcpy(datum.mutable_float_data()->mutable_data(),
+              &features[n * dim_features], dim_features * sizeof(float));
+          string value;
+          datum.SerializeToString(&value);
+          snprintf(key_str, kMaxKeyStrLength, "%d", image_index + n);
+          txns[i]->Put(string(key_str), value);
+        }
       }
-      string value;
-      datum.SerializeToString(&value);
-      snprintf(key_str, kMaxKeyStrLength, "%d", image_index);
-      batch->Put(string(key_str), value);
-      ++image_index;
-      if (image_index % 1000 == 0) {
-        db->Write(leveldb::WriteOptions(), batch);
+      free_slots.Push(slot);
+      image_index += num_features;
+      pending += num_features;
+      if (pending >= 1000) {
+        for (int i = 0; i < num_blobs && !matrix_format; ++i) {
+          txns[i]->Commit();
+        }
+        pending = 0;
         LOG(ERROR)<< "Extracted features of " << image_index <<
             " query images.";
-        delete batch;
-        batch = new leveldb::WriteBatch();
       }
-    }  // for (int n = 0; n < num_features; ++n)
+    }
+    // write the last batch
+    if (pending > 0) {
+      for (int i = 0; i < num_blobs && !matrix_format; ++i) {
+        txns[i]->Commit();
+      }
+      LOG(ERROR)<< "Extracted features of " << image_index <<
+          " query images.";
+    }
+    for (int i = 0; i < num_blobs && matrix_format; ++i) {
+      matrices[i]->Close();
+    }
+  });
+
+  vector<Blob<float>*> input_vec;
+  for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
+    feature_extraction_net->Forward(input_vec);
+    const int slot = free_slots.Pop();
+    for (int i = 0; i < num_blobs; ++i) {
+      const Dtype* feature_blob_data = feature_blobs[i]->cpu_data();
+      slots[slot][i].assign(feature_blob_data,
+          feature_blob_data + feature_blobs[i]->count());
+    }
+    full_slots.Push(slot);
   }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
-  if (image_index % 1000 != 0) {
-    db->Write(leveldb::WriteOptions(), batch);
-    LOG(ERROR)<< "Extracted features of " << image_index <<
-        " query images.";
-  }
+  full_slots.Push(-1);
+  writer.join();
 
-  delete batch;
-  delete db;
   LOG(ERROR)<< "Successfully extracted the features!";
   return 0;
 }
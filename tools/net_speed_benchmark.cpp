@@ -1,11 +1,33 @@
 // Copyright 2014 BVLC and contributors.
+//
+// Times every layer of a net, forward and backward.
+// Usage:
+//    net_speed_benchmark [FLAGS] net_proto [iterations=50] [CPU/GPU]
+//        [Device_id=0]
+// FLAGS:
+//   --warmup=N          untimed forward/backward passes first (default 5)
+//   --batch_sizes=A,B   rerun with the data layers' batch size (or the first
+//                       input dimension) set to each value in turn
+//   --threads=A,B       rerun with each number of BLAS threads
+//   --output=FILE       also write the results, as CSV, or as JSON if FILE
+//                       ends in .json
+//   --trace=FILE        also record the timed passes in the Chrome trace
+//                       format, for chrome://tracing
+//   --huge_pages        back large host allocations with huge pages
+// Each layer reports the min, median, p95 and p99 of its per-iteration time.
+// Convolution, inner product, pooling and LRN layers also report estimated
+// FLOPs and bytes moved, and so the achieved GFLOP/s and GB/s at the median.
 
 #include <cuda_runtime.h>
 #include <fcntl.h>
 #include <google/protobuf/text_format.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -15,22 +37,208 @@
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/command_line.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 #include "caffe/solver.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
+// The timings of one layer in one pass, for one batch size and thread count.
+struct LayerTiming {
+  int batch_size;
+  int threads;
+  string layer;
+  string type;
+  string pass;
+  double flops;
+  double bytes;
+  vector<double> ms;
+};
+
+vector<int> ParseIntList(const string& list) {
+  vector<int> values;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == string::npos) {
+      end = list.size();
+    }
+    values.push_back(atoi(list.substr(begin, end - begin).c_str()));
+    CHECK_GT(values.back(), 0) << "Bad list " << list;
+    begin = end + 1;
+  }
+  return values;
+}
+
+void SetBatchSize(const int batch_size, NetParameter* param) {
+  for (int i = 0; i < param->input_dim_size(); i += 4) {
+    param->set_input_dim(i, batch_size);
+  }
+  for (int i = 0; i < param->layers_size(); ++i) {
+    LayerParameter* layer = param->mutable_layers(i);
+    if (layer->has_data_param()) {
+      layer->mutable_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_image_data_param()) {
+      layer->mutable_image_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_window_data_param()) {
+      layer->mutable_window_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_hdf5_data_param()) {
+      layer->mutable_hdf5_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_memory_data_param()) {
+      layer->mutable_memory_data_param()->set_batch_size(batch_size);
+    }
+  }
+}
+
+void SetNumThreads(const int threads) {
+#ifdef USE_MKL
+  mkl_set_num_threads(threads);
+#else
+  openblas_set_num_threads(threads);
+#endif
+}
+
+// Estimates the forward FLOPs and bytes read and written of a layer; the
+// backward pass is counted as twice the forward FLOPs for layers with
+// weights, and as much as the forward pass otherwise.
+void EstimateCost(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top,
+    double* flops, double* bytes) {
+  const LayerParameter& param = layer->layer_param();
+  double bottom_count = 0, top_count = 0, weight_count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_count += bottom[i]->count();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    top_count += top[i]->count();
+  }
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    weight_count += layer->blobs()[i]->count();
+  }
+  *bytes = sizeof(float) * (bottom_count + top_count + weight_count);
+  *flops = 0;
+  switch (param.type()) {
+  case LayerParameter_LayerType_CONVOLUTION: {
+    const ConvolutionParameter& conv = param.convolution_param();
+    const double kernel_dim = static_cast<double>(bottom[0]->channels()) /
+        conv.group() * conv.kernel_size() * conv.kernel_size();
+    *flops = 2 * top[0]->count() * kernel_dim;
+    break;
+  }
+  case LayerParameter_LayerType_INNER_PRODUCT:
+    *flops = 2 * top[0]->count() *
+        static_cast<double>(bottom[0]->count() / bottom[0]->num());
+    break;
+  case LayerParameter_LayerType_POOLING: {
+    const int kernel_size = param.pooling_param().kernel_size();
+    *flops = static_cast<double>(top[0]->count()) * kernel_size * kernel_size;
+    break;
+  }
+  case LayerParameter_LayerType_LRN:
+    // The sum of squares over the window, then a scale, pow and multiply.
+    *flops = static_cast<double>(top[0]->count()) *
+        (2 * param.lrn_param().local_size() + 4);
+    break;
+  default:
+    break;
+  }
+}
+
+double Percentile(const vector<double>& sorted, const double p) {
+  const int rank = static_cast<int>(std::ceil(p * sorted.size())) - 1;
+  return sorted[std::max(0, std::min<int>(rank, sorted.size() - 1))];
+}
+
+void WriteResults(const string& filename, const vector<LayerTiming>& timings) {
+  const bool json = filename.size() >= 5 &&
+      filename.compare(filename.size() - 5, 5, ".json") == 0;
+  FILE* file = fopen(filename.c_str(), "w");
+  CHECK(file) << "Failed to open " << filename;
+  if (json) {
+    fprintf(file, "[\n");
+  } else {
+    fprintf(file, "batch_size,threads,layer,type,pass,iterations,min_ms,"
+        "median_ms,p95_ms,p99_ms,flops,bytes,gflops_per_s,gb_per_s\n");
+  }
+  for (int i = 0; i < timings.size(); ++i) {
+    const LayerTiming& t = timings[i];
+    vector<double> sorted(t.ms);
+    std::sort(sorted.begin(), sorted.end());
+    const double median = Percentile(sorted, 0.5);
+    const double seconds = std::max(median, 1e-6) / 1000;
+    if (json) {
+      fprintf(file, "  {\"batch_size\": %d, \"threads\": %d, \"layer\": \"%s\","
+          " \"type\": \"%s\", \"pass\": \"%s\", \"iterations\": %d,"
+          " \"min_ms\": %g, \"median_ms\": %g, \"p95_ms\": %g,"
+          " \"p99_ms\": %g, \"flops\": %g, \"bytes\": %g,"
+          " \"gflops_per_s\": %g, \"gb_per_s\": %g}%s\n",
+          t.batch_size, t.threads, t.layer.c_str(), t.type.c_str(),
+          t.pass.c_str(), static_cast<int>(sorted.size()), sorted[0], median,
+          Percentile(sorted, 0.95), Percentile(sorted, 0.99), t.flops,
+          t.bytes, t.flops / seconds / 1e9, t.bytes / seconds / 1e9,
+          i + 1 < timings.size() ? "," : "");
+    } else {
+      fprintf(file, "%d,%d,%s,%s,%s,%d,%g,%g,%g,%g,%g,%g,%g,%g\n",
+          t.batch_size, t.threads, t.layer.c_str(), t.type.c_str(),
+          t.pass.c_str(), static_cast<int>(sorted.size()), sorted[0], median,
+          Percentile(sorted, 0.95), Percentile(sorted, 0.99), t.flops,
+          t.bytes, t.flops / seconds / 1e9, t.bytes / seconds / 1e9);
+    }
+  }
+  if (json) {
+    fprintf(file, "]\n");
+  }
+  CHECK_EQ(fclose(file), 0) << "Failed to write " << filename;
+}
+
+void LogTiming(const LayerTiming& t) {
+  vector<double> sorted(t.ms);
+  std::sort(sorted.begin(), sorted.end());
+  const double median = Percentile(sorted, 0.5);
+  const double seconds = std::max(median, 1e-6) / 1000;
+  std::ostringstream line;
+  line << t.layer << "\t" << t.pass << ": min " << sorted[0] << " median "
+      << median << " p95 " << Percentile(sorted, 0.95) << " p99 "
+      << Percentile(sorted, 0.99) << " ms";
+  if (t.flops > 0) {
+    line << ", " << t.flops / seconds / 1e9 << " GFLOP/s";
+  }
+  if (t.bytes > 0) {
+    line << ", " << t.bytes / seconds / 1e9 << " GB/s";
+  }
+  LOG(ERROR) << line.str();
+}
+
 int main(int argc, char** argv) {
+  CommandLineFlags flags(&argc, argv);
+  const int warmup = flags.GetInt("warmup", 5);
+  const string batch_sizes_flag = flags.GetString("batch_sizes", "");
+  const string threads_flag = flags.GetString("threads", "");
+  const string output = flags.GetString("output", "");
+  const string trace_file = flags.GetString("trace", "");
+  const bool huge_pages = flags.GetBool("huge_pages", false);
+  flags.CheckAllUsed();
   int total_iter = 50;
   if (argc < 2 || argc > 5) {
-    LOG(ERROR) << "net_speed_benchmark net_proto [iterations=50]"
-        " [CPU/GPU] [Device_id=0]";
+    LOG(ERROR) << "net_speed_benchmark [--warmup=5] [--batch_sizes=A,B,...]"
+        " [--threads=A,B,...] [--output=FILE.csv/.json] [--trace=FILE]"
+        " [--huge_pages] net_proto"
+        " [iterations=50] [CPU/GPU] [Device_id=0]";
     return 1;
   }
 
   if (argc >=3) {
     total_iter = atoi(argv[2]);
   }
+  CHECK_GT(total_iter, 0);
 
   LOG(ERROR) << "Testing for " << total_iter << "Iterations.";
 
@@ -49,53 +257,115 @@ int main(int argc, char** argv) {
   }
 
   Caffe::set_phase(Caffe::TRAIN);
-  Net<float> caffe_net(argv[1]);
-
-  // Run the network without training.
-  LOG(ERROR) << "Performing Forward";
-  // Note that for the speed benchmark, we will assume that the network does
-  // not take any input blobs.
-  float initial_loss;
-  caffe_net.Forward(vector<Blob<float>*>(), &initial_loss);
-  LOG(ERROR) << "Initial loss: " << initial_loss;
-  LOG(ERROR) << "Performing Backward";
-  caffe_net.Backward();
-
-  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  LOG(ERROR) << "*** Benchmark begins ***";
-  Timer total_timer;
-  total_timer.Start();
-  Timer forward_timer;
-  forward_timer.Start();
-  Timer timer;
-  for (int i = 0; i < layers.size(); ++i) {
-    const string& layername = layers[i]->layer_param().name();
-    timer.Start();
-    for (int j = 0; j < total_iter; ++j) {
-      layers[i]->Forward(bottom_vecs[i], &top_vecs[i]);
+  HostMemoryPool::Get().set_huge_pages(huge_pages);
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &net_param);
+  // 0 stands for the batch size and thread count already configured.
+  const vector<int> batch_sizes = batch_sizes_flag.empty() ?
+      vector<int>(1, 0) : ParseIntList(batch_sizes_flag);
+  const vector<int> thread_counts = threads_flag.empty() ?
+      vector<int>(1, 0) : ParseIntList(threads_flag);
+  vector<LayerTiming> timings;
+  for (int b = 0; b < batch_sizes.size(); ++b) {
+    // The blocks of the previous batch size's net are of other size
+    // classes, and would only be held.
+    HostMemoryPool::Get().Trim();
+    NetParameter param(net_param);
+    if (batch_sizes[b] > 0) {
+      SetBatchSize(batch_sizes[b], &param);
     }
-    LOG(ERROR) << layername << "\tforward: " << timer.MilliSeconds() <<
-        " milli seconds.";
-  }
-  LOG(ERROR) << "Forward pass: " << forward_timer.MilliSeconds() <<
-      " milli seconds.";
-  Timer backward_timer;
-  backward_timer.Start();
-  for (int i = layers.size() - 1; i >= 0; --i) {
-    const string& layername = layers[i]->layer_param().name();
-    timer.Start();
-    for (int j = 0; j < total_iter; ++j) {
-      layers[i]->Backward(top_vecs[i], true, &bottom_vecs[i]);
+    Net<float> caffe_net(param);
+    const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+    vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
+    vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
+    const int batch_size = top_vecs[0].empty() ? 0 : top_vecs[0][0]->num();
+    for (int t = 0; t < thread_counts.size(); ++t) {
+      if (thread_counts[t] > 0) {
+        SetNumThreads(thread_counts[t]);
+      }
+      LOG(ERROR) << "*** Benchmark begins: batch size " << batch_size
+          << ", threads " << thread_counts[t] << " ***";
+      // Note that for the speed benchmark, we will assume that the network
+      // does not take any input blobs.
+      for (int j = 0; j < warmup; ++j) {
+        caffe_net.ForwardPrefilled();
+        caffe_net.Backward();
+      }
+      const int first = timings.size();
+      for (int i = 0; i < layers.size(); ++i) {
+        LayerTiming timing;
+        timing.batch_size = batch_size;
+        timing.threads = thread_counts[t];
+        timing.layer = layers[i]->layer_param().name();
+        timing.type = LayerParameter_LayerType_Name(
+            layers[i]->layer_param().type());
+        timing.pass = "forward";
+        EstimateCost(layers[i].get(), bottom_vecs[i], top_vecs[i], &timing.flops,
+            &timing.bytes);
+        timings.push_back(timing);
+        timing.pass = "backward";
+        const bool has_weights = layers[i]->blobs().size() > 0;
+        timing.flops *= has_weights ? 2 : 1;
+        timings.push_back(timing);
+      }
+      LayerTiming forward_total = timings[first];
+      forward_total.layer = "total";
+      forward_total.type = "NET";
+      forward_total.flops = forward_total.bytes = 0;
+      forward_total.pass = "forward";
+      LayerTiming backward_total = forward_total;
+      backward_total.pass = "backward";
+      for (int i = first; i < timings.size(); i += 2) {
+        forward_total.flops += timings[i].flops;
+        backward_total.flops += timings[i + 1].flops;
+      }
+      // The layers run in net order within every iteration, so each layer
+      // sees the caches as it would in training.
+      if (!trace_file.empty()) {
+        Tracer::Enable();
+      }
+      // Timer waits for the device in GPU mode.
+      Timer timer;
+      for (int j = 0; j < total_iter; ++j) {
+        double forward_ms = 0, backward_ms = 0;
+        for (int i = 0; i < layers.size(); ++i) {
+          timer.Start();
+          layers[i]->Forward(bottom_vecs[i], &top_vecs[i]);
+          timings[first + 2 * i].ms.push_back(timer.MicroSeconds() / 1000);
+          forward_ms += timings[first + 2 * i].ms.back();
+        }
+        for (int i = layers.size() - 1; i >= 0; --i) {
+          timer.Start();
+          layers[i]->Backward(top_vecs[i], true, &bottom_vecs[i]);
+          timings[first + 2 * i + 1].ms.push_back(
+              timer.MicroSeconds() / 1000);
+          backward_ms += timings[first + 2 * i + 1].ms.back();
+        }
+        forward_total.ms.push_back(forward_ms);
+        backward_total.ms.push_back(backward_ms);
+      }
+      Tracer::Disable();
+      timings.push_back(forward_total);
+      timings.push_back(backward_total);
+      for (int i = first; i < timings.size(); ++i) {
+        LogTiming(timings[i]);
+      }
+      LOG(ERROR) << "*** Benchmark ends ***";
     }
-    LOG(ERROR) << layername << "\tbackward: "
-        << timer.MilliSeconds() << " milli seconds.";
-  }
-  LOG(ERROR) << "Backward pass: " << backward_timer.MilliSeconds() <<
-      " milli seconds.";
-  LOG(ERROR) << "Total Time: " << total_timer.MilliSeconds() <<
-      " milli seconds.";
-  LOG(ERROR) << "*** Benchmark ends ***";
+    const HostMemoryPool::Stats pool = HostMemoryPool::Get().stats();
+    LOG(ERROR) << "Host memory: " << caffe_net.memory_tracker()->current_bytes()
+        / 1048576. << " MB, peak "
+        << caffe_net.memory_tracker()->peak_bytes() / 1048576. << " MB; "
+        << pool.hits << " of " << pool.hits + pool.misses
+        << " allocations reused pooled memory";
+  }
+  if (!output.empty()) {
+    LOG(ERROR) << "Writing results to " << output;
+    WriteResults(output, timings);
+  }
+  if (!trace_file.empty()) {
+    LOG(ERROR) << "Writing the trace to " << trace_file;
+    CHECK(Tracer::WriteChromeTrace(trace_file));
+  }
   return 0;
 }